@@ -0,0 +1,92 @@
+# Lists what the firmware placed in ITCM and DTCM, biggest first, and how
+# much of each is left. The build runs it after linking:
+#
+#   cmake -DNM=<nm> -DELF=<firmware.elf> [-DOUTPUT=<file>] \
+#       -P cmake/TcmReport.cmake
+
+execute_process(
+    COMMAND ${NM} --print-size --size-sort --reverse-sort --demangle ${ELF}
+    OUTPUT_VARIABLE symbols
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+
+execute_process(
+    COMMAND ${NM} ${ELF}
+    OUTPUT_VARIABLE markers
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+
+# Brackets and semicolons in symbol names would upset CMake's lists.
+string(REPLACE "[" "(" symbols "${symbols}")
+string(REPLACE "]" ")" symbols "${symbols}")
+string(REPLACE ";" "," symbols "${symbols}")
+string(REPLACE "\n" ";" symbols "${symbols}")
+
+# Value of a symbol defined by tcm.ld, in decimal
+function(marker name out)
+    if(NOT markers MATCHES "([0-9a-fA-F]+) [A-Za-z] ${name}\n")
+        message(FATAL_ERROR "${name} not found in ${ELF}; "
+            "was it linked with tcm.ld?")
+    endif()
+    math(EXPR value "0x${CMAKE_MATCH_1}" OUTPUT_FORMAT DECIMAL)
+    set(${out} ${value} PARENT_SCOPE)
+endfunction()
+
+# Appends the symbols between begin and end, and their total, to report
+function(listRegion title begin end length reserved)
+    set(lines "")
+    foreach(line IN LISTS symbols)
+        if(NOT line MATCHES "^([0-9a-fA-F]+) ([0-9a-fA-F]+) [A-Za-z] (.*)$")
+            continue()
+        endif()
+        math(EXPR address "0x${CMAKE_MATCH_1}" OUTPUT_FORMAT DECIMAL)
+        math(EXPR size "0x${CMAKE_MATCH_2}" OUTPUT_FORMAT DECIMAL)
+        if(address GREATER_EQUAL begin AND address LESS end)
+            string(LENGTH "${size}" digits)
+            math(EXPR pad "8 - ${digits}")
+            string(REPEAT " " ${pad} indent)
+            string(APPEND lines "${indent}${size}  ${CMAKE_MATCH_3}\n")
+        endif()
+    endforeach()
+
+    math(EXPR used "${end} - ${begin}")
+    math(EXPR free "${length} - ${used} - ${reserved}")
+    set(summary "${title}: ${used} of ${length} bytes used")
+    if(reserved GREATER 0)
+        string(APPEND summary ", ${reserved} kept for the stack")
+    endif()
+    string(APPEND report "${summary}, ${free} free\n${lines}")
+    set(report "${report}" PARENT_SCOPE)
+endfunction()
+
+# The regions in libDaisy's linker script. Anything else placed in them
+# comes before the sections from tcm.ld, so counts as used.
+set(itcm_origin 0)
+set(itcm_length 65536)
+math(EXPR dtcm_origin "0x20000000" OUTPUT_FORMAT DECIMAL)
+set(dtcm_length 131072)
+
+marker(_eitcm_text itcm_end)
+marker(_edtcm_bss dtcm_end)
+marker(tcm_stack_size stack_size)
+
+set(report "")
+listRegion(ITCM ${itcm_origin} ${itcm_end} ${itcm_length} 0)
+listRegion(DTCM ${dtcm_origin} ${dtcm_end} ${dtcm_length} ${stack_size})
+
+# Audio path data the linker can't see
+string(APPEND report "Left in SRAM, read through the data cache:\n"
+    "  the wave tables, too big for DTCM\n"
+    "  the pitch detector's buffers, about 1 KB that q allocates on the "
+    "heap, read every analysis sample\n")
+
+message("${report}")
+if(OUTPUT)
+    file(WRITE ${OUTPUT} "${report}")
+endif()
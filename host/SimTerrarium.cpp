@@ -0,0 +1,135 @@
+#include "SimTerrarium.h"
+
+#include <utility>
+
+uint64_t SimClock::micros()
+{
+    return hardware ? hardware->micros() : 0;
+}
+
+void SimClock::idle()
+{
+    if (hardware) { hardware->advance(); }
+}
+
+bool RamFlash::load(const std::string& path)
+{
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (!file) { return false; }
+    std::vector<uint8_t> bytes(_bytes.size() + 1);
+    const auto size = std::fread(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+    if (size != _bytes.size()) { return false; }
+    std::copy_n(bytes.begin(), size, _bytes.begin());
+    return true;
+}
+
+bool RamFlash::save(const std::string& path) const
+{
+    auto* file = std::fopen(path.c_str(), "wb");
+    if (!file) { return false; }
+    const auto size = std::fwrite(_bytes.data(), 1, _bytes.size(), file);
+    return (std::fclose(file) == 0) && (size == _bytes.size());
+}
+
+SimTerrarium::SimTerrarium(float sample_rate, size_t block_size,
+    std::vector<float> input) :
+    _sample_rate(sample_rate),
+    _block_size(block_size),
+    _in(block_size),
+    _out(block_size),
+    _silent(block_size)
+{
+    initKnobRate();
+    setInput(std::move(input));
+}
+
+void SimTerrarium::SetSampleRate(float sample_rate)
+{
+    _sample_rate = sample_rate;
+    initKnobRate();
+}
+
+void SimTerrarium::setInput(std::vector<float> input)
+{
+    _input = std::move(input);
+    _input_pos = 0;
+    if (_input.empty()) { _input.assign(_block_size, 0.0f); }
+}
+
+// As Terrarium::InitKnobRate
+void SimTerrarium::initKnobRate()
+{
+    constexpr float knob_update_time = 0.001f;
+    const auto samples_per_update =
+        static_cast<size_t>(_sample_rate * knob_update_time);
+    _knob_interval = std::max<size_t>(samples_per_update / _block_size, 1);
+    const auto poll_rate = _sample_rate / _block_size / _knob_interval;
+    for (auto& knob : knobs) { knob.Init(poll_rate); }
+}
+
+void SimTerrarium::DebounceSwitches()
+{
+    for (auto& toggle : toggles)
+    {
+        toggle.Debounce();
+    }
+
+    for (auto& stomp : stomps)
+    {
+        stomp.Debounce();
+    }
+}
+
+void SimTerrarium::setScript(std::vector<Event> events)
+{
+    _events = std::move(events);
+    _next_event = 0;
+    _script_start = micros();
+    applyDue();
+}
+
+void SimTerrarium::applyDue()
+{
+    while (_next_event < _events.size() &&
+        _script_start + _events[_next_event].time <= micros())
+    {
+        const auto& event = _events[_next_event++];
+        switch (event.control)
+        {
+        case Control::knob:
+            knobs[event.index].set(event.value);
+            break;
+        case Control::toggle:
+            toggles[event.index].set(event.value != 0);
+            break;
+        case Control::stomp:
+            stomps[event.index].set(event.value != 0);
+            break;
+        case Control::loop:
+            _script_start += event.time;
+            _next_event = 0;
+            break;
+        }
+    }
+}
+
+void SimTerrarium::advance()
+{
+    applyDue();
+
+    for (auto& x : _in)
+    {
+        x = _input[_input_pos];
+        _input_pos = (_input_pos + 1) % _input.size();
+    }
+
+    if (_callback)
+    {
+        const float* in[] = {_in.data(), _silent.data()};
+        float* out[] = {_out.data(), _silent.data()};
+        _callback(in, out, _block_size);
+        if (on_output) { on_output(_out.data(), _block_size); }
+    }
+    _samples += _block_size;
+}
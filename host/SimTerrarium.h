@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <util/PersistentSettings.h>
+
+class SimTerrarium;
+
+// Scheduler clock on simulated time, in microseconds. Idling plays the
+// next audio block, as the audio interrupt would wake the pedal, so the
+// control loop and the audio run as fast as the CPU allows.
+struct SimClock
+{
+    static uint32_t now() { return static_cast<uint32_t>(micros()); }
+    static uint32_t frequency() { return 1000000; }
+    static void idle();
+
+    // Without wrapping
+    static uint64_t micros();
+
+    static inline SimTerrarium* hardware = nullptr;
+};
+
+// A knob, moved by the script. Processing slews towards the position as
+// libDaisy's AnalogControl does.
+class SimKnob
+{
+public:
+    void Init(float update_rate)
+    {
+        constexpr float slew_seconds = 0.002f;
+        _coefficient =
+            std::min(1 / (slew_seconds * update_rate * 0.5f), 1.0f);
+    }
+
+    float Process()
+    {
+        _value += _coefficient * (_position - _value);
+        return _value;
+    }
+
+    float Value() const { return _value; }
+
+    void set(float position) { _position = position; }
+
+private:
+    float _coefficient = 1;
+    float _position = 0;
+    float _value = 0;
+};
+
+// A toggle or foot switch, set by the script. Debounces as libDaisy's
+// Switch does: pressed once eight debounces in a row see it down.
+class SimSwitch
+{
+public:
+    void Debounce()
+    {
+        _state = static_cast<uint8_t>((_state << 1) | (_raw ? 1 : 0));
+        if (_state == 0x7F) { _pressed_ms = SimClock::micros() / 1000; }
+        _rising_edge = (_state == 0x7F);
+    }
+
+    bool Pressed() const { return _state == 0xFF; }
+    bool RisingEdge() const { return _rising_edge; }
+    bool RawState() const { return _raw; }
+
+    float TimeHeldMs() const
+    {
+        return Pressed() ?
+            static_cast<float>(SimClock::micros() / 1000 - _pressed_ms) : 0;
+    }
+
+    void set(bool down) { _raw = down; }
+
+private:
+    bool _raw = false;
+    uint8_t _state = 0;
+    bool _rising_edge = false;
+    uint64_t _pressed_ms = 0;
+};
+
+// An LED, counting how often its brightness changes
+class SimLed
+{
+public:
+    void Set(float brightness)
+    {
+        if (brightness != _brightness) { _changes++; }
+        _brightness = brightness;
+    }
+
+    float brightness() const { return _brightness; }
+    uint64_t changes() const { return _changes; }
+
+private:
+    float _brightness = 0;
+    uint64_t _changes = 0;
+};
+
+// The QSPI chip's settings bank, in memory. Erasing sets a sector to 0xFF
+// and programming can only clear bits, as on the chip.
+class RamFlash
+{
+public:
+    static constexpr size_t sector_size = 4096;
+
+    RamFlash() : _bytes(settings_bank_size, 0xFF) {}
+
+    size_t size() const { return _bytes.size(); }
+    const uint8_t* data() const { return _bytes.data(); }
+
+    bool erase(size_t offset, size_t size)
+    {
+        std::fill_n(_bytes.begin() + offset, size, 0xFF);
+        _erases += size / sector_size;
+        return true;
+    }
+
+    bool write(size_t offset, const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) { _bytes[offset + i] &= data[i]; }
+        _writes++;
+        return true;
+    }
+
+    uint64_t erases() const { return _erases; }
+    uint64_t writes() const { return _writes; }
+
+    // An image file keeps the settings from one run to the next. Loading
+    // fails if the file is missing or the wrong size.
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+private:
+    std::vector<uint8_t> _bytes;
+    uint64_t _erases = 0;
+    uint64_t _writes = 0;
+};
+
+// The pedal's hardware on Linux, with the interface of Terrarium for
+// Pedal. A script moves the knobs and switches at set times, the audio
+// loops over an input signal, and printing and telemetry go to files.
+class SimTerrarium
+{
+public:
+    using Clock = SimClock;
+    using AudioCallback = void (*)(const float* const* in, float** out,
+        size_t size);
+
+    static constexpr size_t traffic_chunk = 4 * 1024;
+
+    static constexpr int knob_count = 6;
+    static constexpr int toggle_count = 4;
+    static constexpr int stomp_count = 2;
+    static constexpr int led_count = 2;
+
+    enum class Control : uint8_t
+    {
+        knob,
+        toggle,
+        stomp,
+        // Starts the script over
+        loop
+    };
+
+    struct Event
+    {
+        uint64_t time; // microseconds
+        Control control;
+        int index;
+        float value;
+    };
+
+    // input is played over and over.
+    SimTerrarium(float sample_rate, size_t block_size,
+        std::vector<float> input);
+
+    size_t KnobInterval() const { return _knob_interval; }
+    void DebounceSwitches();
+
+    // Takes any rate; the input plays on at the new one.
+    void SetSampleRate(float sample_rate);
+
+    float SampleRate() const { return _sample_rate; }
+    void StartAudio(AudioCallback callback) { _callback = callback; }
+    uint32_t Micros() const { return static_cast<uint32_t>(micros()); }
+
+    void StartLog() {}
+
+    template <typename... Args>
+    void PrintLine(const char* format, Args... args)
+    {
+        if (!log) { return; }
+        std::fprintf(log, format, args...);
+        std::fputc('\n', log);
+    }
+
+    bool WriteUsb(const uint8_t* data, size_t size)
+    {
+        if (usb) { std::fwrite(data, 1, size, usb); }
+        return true;
+    }
+
+    // No buses to load here
+    void StreamMemory() {}
+
+    PersistentSettings<RamFlash>& Settings() { return _settings; }
+
+    std::array<SimKnob, knob_count> knobs;
+    std::array<SimSwitch, toggle_count> toggles;
+    std::array<SimSwitch, stomp_count> stomps;
+    std::array<SimLed, led_count> leds;
+
+    // Replaces the input, from the start.
+    void setInput(std::vector<float> input);
+
+    // The script, in order of time. Events at time 0 take effect at once,
+    // before the pedal boots.
+    void setScript(std::vector<Event> events);
+
+    // Applies the events due, and plays one audio block.
+    void advance();
+
+    uint64_t micros() const
+    {
+        return _samples * 1000000 / static_cast<uint64_t>(_sample_rate);
+    }
+
+    uint64_t samples() const { return _samples; }
+    RamFlash& flash() { return _flash; }
+
+    // Called with each block of output
+    std::function<void(const float*, size_t)> on_output;
+    // Where PrintLine and WriteUsb go; null to drop them
+    std::FILE* log = stdout;
+    std::FILE* usb = nullptr;
+
+private:
+    void applyDue();
+    void initKnobRate();
+
+    float _sample_rate;
+    const size_t _block_size;
+    size_t _knob_interval;
+    std::vector<float> _input;
+    size_t _input_pos = 0;
+    std::vector<float> _in;
+    std::vector<float> _out;
+    std::vector<float> _silent;
+    AudioCallback _callback = nullptr;
+    uint64_t _samples = 0;
+
+    std::vector<Event> _events;
+    size_t _next_event = 0;
+    // Start of the current pass through the script
+    uint64_t _script_start = 0;
+
+    RamFlash _flash;
+    PersistentSettings<RamFlash> _settings{_flash};
+};
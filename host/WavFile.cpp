@@ -0,0 +1,182 @@
+#include "WavFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+
+constexpr uint16_t format_pcm = 1;
+constexpr uint16_t format_float = 3;
+constexpr uint16_t format_extensible = 0xFFFE;
+
+uint32_t readU32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint16_t readU16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+void writeU32(std::FILE* f, uint32_t v)
+{
+    const uint8_t b[4] = {
+        uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+    std::fwrite(b, 1, sizeof(b), f);
+}
+
+void writeU16(std::FILE* f, uint16_t v)
+{
+    const uint8_t b[2] = {uint8_t(v), uint8_t(v >> 8)};
+    std::fwrite(b, 1, sizeof(b), f);
+}
+
+void writeHeader(std::FILE* f, uint32_t sample_rate, size_t frames)
+{
+    const auto data_size = static_cast<uint32_t>(frames * sizeof(float));
+    std::fwrite("RIFF", 1, 4, f);
+    writeU32(f, 36 + data_size);
+    std::fwrite("WAVEfmt ", 1, 8, f);
+    writeU32(f, 16);
+    writeU16(f, format_float);
+    writeU16(f, 1);
+    writeU32(f, sample_rate);
+    writeU32(f, sample_rate * sizeof(float));
+    writeU16(f, sizeof(float));
+    writeU16(f, 32);
+    std::fwrite("data", 1, 4, f);
+    writeU32(f, data_size);
+}
+
+} // namespace
+
+
+WavReader::WavReader(const std::string& path)
+{
+    _file = std::fopen(path.c_str(), "rb");
+    if (!_file) { return; }
+
+    uint8_t riff[12];
+    if (std::fread(riff, 1, sizeof(riff), _file) != sizeof(riff) ||
+        std::memcmp(riff, "RIFF", 4) || std::memcmp(riff + 8, "WAVE", 4))
+    {
+        std::fclose(_file);
+        _file = nullptr;
+        return;
+    }
+
+    bool have_format = false;
+    uint8_t chunk[8];
+    while (std::fread(chunk, 1, sizeof(chunk), _file) == sizeof(chunk))
+    {
+        const auto size = readU32(chunk + 4);
+        if (!std::memcmp(chunk, "fmt ", 4) && size >= 16)
+        {
+            std::array<uint8_t, 40> fmt{};
+            const auto n = std::min<size_t>(size, fmt.size());
+            if (std::fread(fmt.data(), 1, n, _file) != n) { break; }
+            std::fseek(_file, static_cast<long>(size - n + (size & 1)), SEEK_CUR);
+            _format = readU16(fmt.data());
+            _channels = readU16(fmt.data() + 2);
+            _sample_rate = readU32(fmt.data() + 4);
+            _bits = readU16(fmt.data() + 14);
+            if (_format == format_extensible && n >= 26)
+            {
+                _format = readU16(fmt.data() + 24);
+            }
+            have_format = true;
+        }
+        else if (!std::memcmp(chunk, "data", 4) && have_format)
+        {
+            const auto frame_size = _channels * (_bits / 8);
+            _frames = frame_size ? size / frame_size : 0;
+            _remaining = _frames;
+            const bool supported =
+                (_format == format_pcm &&
+                    (_bits == 16 || _bits == 24 || _bits == 32)) ||
+                (_format == format_float && _bits == 32);
+            if (supported && _channels > 0) { return; }
+            break;
+        }
+        else
+        {
+            std::fseek(_file, static_cast<long>(size + (size & 1)), SEEK_CUR);
+        }
+    }
+
+    std::fclose(_file);
+    _file = nullptr;
+}
+
+WavReader::~WavReader()
+{
+    if (_file) { std::fclose(_file); }
+}
+
+size_t WavReader::read(float* out, size_t max_frames, uint16_t channel)
+{
+    if (!_file || channel >= _channels) { return 0; }
+
+    const auto sample_size = _bits / 8u;
+    const auto frame_size = sample_size * _channels;
+    uint8_t frame[64 * 4];
+    if (frame_size > sizeof(frame)) { return 0; }
+
+    size_t count = 0;
+    while (count < max_frames && _remaining > 0)
+    {
+        if (std::fread(frame, 1, frame_size, _file) != frame_size)
+        {
+            _remaining = 0;
+            break;
+        }
+        --_remaining;
+
+        const auto p = frame + (channel * sample_size);
+        float value = 0;
+        if (_format == format_float)
+        {
+            std::memcpy(&value, p, sizeof(value));
+        }
+        else if (_bits == 16)
+        {
+            value = static_cast<int16_t>(readU16(p)) / 32768.0f;
+        }
+        else if (_bits == 24)
+        {
+            const auto raw = static_cast<int32_t>(
+                (p[0] << 8) | (p[1] << 16) | (uint32_t(p[2]) << 24));
+            value = (raw >> 8) / 8388608.0f;
+        }
+        else
+        {
+            value = static_cast<int32_t>(readU32(p)) / 2147483648.0f;
+        }
+        out[count++] = value;
+    }
+    return count;
+}
+
+WavWriter::WavWriter(const std::string& path, uint32_t sample_rate)
+{
+    _file = std::fopen(path.c_str(), "wb");
+    _sample_rate = sample_rate;
+    if (_file) { writeHeader(_file, _sample_rate, 0); }
+}
+
+WavWriter::~WavWriter()
+{
+    if (!_file) { return; }
+    std::fseek(_file, 0, SEEK_SET);
+    writeHeader(_file, _sample_rate, _frames);
+    std::fclose(_file);
+}
+
+void WavWriter::write(const float* data, size_t frames)
+{
+    if (!_file) { return; }
+    _frames += std::fwrite(data, sizeof(float), frames, _file);
+}
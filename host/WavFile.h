@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Streams interleaved frames out of a PCM (16, 24, 32 bit) or 32-bit float
+// WAV file, converting samples to float.
+class WavReader
+{
+public:
+    explicit WavReader(const std::string& path);
+    ~WavReader();
+
+    WavReader(const WavReader&) = delete;
+    WavReader& operator=(const WavReader&) = delete;
+
+    bool isOpen() const { return _file != nullptr; }
+    uint32_t sampleRate() const { return _sample_rate; }
+    uint16_t channels() const { return _channels; }
+    size_t frames() const { return _frames; }
+
+    // Reads up to max_frames frames of the given channel into out.
+    // Returns the number of frames read.
+    size_t read(float* out, size_t max_frames, uint16_t channel = 0);
+
+private:
+    std::FILE* _file = nullptr;
+    uint32_t _sample_rate = 0;
+    uint16_t _channels = 0;
+    uint16_t _format = 0;
+    uint16_t _bits = 0;
+    size_t _frames = 0;
+    size_t _remaining = 0;
+};
+
+// Writes a mono 32-bit float WAV file.
+class WavWriter
+{
+public:
+    WavWriter(const std::string& path, uint32_t sample_rate);
+    ~WavWriter();
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    bool isOpen() const { return _file != nullptr; }
+
+    void write(const float* data, size_t frames);
+
+private:
+    std::FILE* _file = nullptr;
+    uint32_t _sample_rate = 0;
+    size_t _frames = 0;
+};
@@ -0,0 +1,199 @@
+// Compares the decimated analysis paths against full-rate analysis.
+//
+// Usage: terrarium-analyze input.wav...
+//
+// Each file runs through Analyzer at decimation 1, 2 and 4. For 2 and 4,
+// the pitch and onset timing are compared with the full-rate results.
+// Each result is printed as one tab-separated line: file, decimation,
+// metric, value.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <util/Analyzer.h>
+
+#include "WavFile.h"
+
+namespace
+{
+
+constexpr size_t block_size = 48;
+
+// Onsets further apart than this aren't considered the same note.
+constexpr double max_onset_skew_ms = 50;
+
+struct Result
+{
+    double ns_per_sample = 0;
+
+    // Detected frequency after each block, 0 while the gate is closed
+    std::vector<float> frequency;
+
+    // Sample indices where the gate opened
+    std::vector<size_t> onsets;
+
+    // Sample index of the first pitch event after each onset
+    std::vector<size_t> first_pitch;
+};
+
+Result analyze(const std::vector<float>& signal, float sample_rate,
+    size_t decimation)
+{
+    Result result;
+    Analyzer analyzer(sample_rate, decimation);
+    analyzer.setTrigger(0.01f);
+
+    bool gate = false;
+    bool awaiting_pitch = false;
+    std::chrono::steady_clock::duration elapsed{};
+    for (size_t begin = 0; begin < signal.size(); begin += block_size)
+    {
+        const auto size = std::min(block_size, signal.size() - begin);
+        const auto start = std::chrono::steady_clock::now();
+        analyzer.process(signal.data() + begin, size);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (analyzer.gate()[i] && !gate)
+            {
+                result.onsets.push_back(begin + i);
+                awaiting_pitch = true;
+            }
+            gate = analyzer.gate()[i];
+        }
+        if (awaiting_pitch && analyzer.pitchEventCount() > 0)
+        {
+            const auto& event = analyzer.pitchEvents()[0];
+            result.first_pitch.push_back(begin + event.index);
+            awaiting_pitch = false;
+        }
+        result.frequency.push_back(gate ? analyzer.frequency() : 0.0f);
+    }
+
+    result.ns_per_sample =
+        std::chrono::duration<double, std::nano>(elapsed).count() /
+        signal.size();
+    return result;
+}
+
+// Mean and maximum distance, in milliseconds, from each reference time to
+// the nearest matching time. Also returns how many found no match.
+void compareTimes(const std::vector<size_t>& reference,
+    const std::vector<size_t>& times, float sample_rate,
+    double& mean_ms, double& max_ms, size_t& missed)
+{
+    double sum = 0;
+    size_t matched = 0;
+    mean_ms = 0;
+    max_ms = 0;
+    missed = 0;
+    for (const auto t : reference)
+    {
+        double best = max_onset_skew_ms;
+        for (const auto u : times)
+        {
+            const auto skew_ms = (static_cast<double>(u) - t) * 1000 /
+                sample_rate;
+            best = std::min(best, std::abs(skew_ms));
+        }
+        if (best >= max_onset_skew_ms)
+        {
+            ++missed;
+            continue;
+        }
+        sum += best;
+        max_ms = std::max(max_ms, best);
+        ++matched;
+    }
+    if (matched > 0) { mean_ms = sum / matched; }
+}
+
+void report(const std::string& file, size_t decimation, const char* metric,
+    double value)
+{
+    std::printf("%s\t%zu\t%s\t%.4g\n", file.c_str(), decimation, metric,
+        value);
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::fputs("usage: terrarium-analyze input.wav...\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    for (int a = 1; a < argc; ++a)
+    {
+        const std::string path = argv[a];
+        WavReader reader(path);
+        if (!reader.isOpen())
+        {
+            std::fprintf(stderr, "can't read %s\n", path.c_str());
+            return EXIT_FAILURE;
+        }
+
+        std::vector<float> signal;
+        std::vector<float> chunk(4096);
+        size_t count = 0;
+        while ((count = reader.read(chunk.data(), chunk.size(), 0)) > 0)
+        {
+            signal.insert(signal.end(), chunk.begin(), chunk.begin() + count);
+        }
+
+        const auto sample_rate = static_cast<float>(reader.sampleRate());
+        const auto reference = analyze(signal, sample_rate, 1);
+        report(path, 1, "ns/sample", reference.ns_per_sample);
+        report(path, 1, "onsets", reference.onsets.size());
+
+        for (const size_t decimation : {2, 4})
+        {
+            const auto result = analyze(signal, sample_rate, decimation);
+            report(path, decimation, "ns/sample", result.ns_per_sample);
+
+            // Pitch agreement over blocks where both paths have one
+            std::vector<double> cents;
+            for (size_t b = 0; b < reference.frequency.size(); ++b)
+            {
+                const auto f0 = reference.frequency[b];
+                const auto f1 = result.frequency[b];
+                if (f0 > 0 && f1 > 0)
+                {
+                    cents.push_back(std::abs(1200 * std::log2(f1 / f0)));
+                }
+            }
+            std::sort(cents.begin(), cents.end());
+            if (!cents.empty())
+            {
+                report(path, decimation, "pitch_cents_median",
+                    cents[cents.size() / 2]);
+                report(path, decimation, "pitch_cents_p95",
+                    cents[cents.size() * 95 / 100]);
+            }
+
+            double mean_ms = 0;
+            double max_ms = 0;
+            size_t missed = 0;
+            compareTimes(reference.onsets, result.onsets, sample_rate,
+                mean_ms, max_ms, missed);
+            report(path, decimation, "onset_skew_mean_ms", mean_ms);
+            report(path, decimation, "onset_skew_max_ms", max_ms);
+            report(path, decimation, "onsets_missed", missed);
+
+            compareTimes(reference.first_pitch, result.first_pitch,
+                sample_rate, mean_ms, max_ms, missed);
+            report(path, decimation, "first_pitch_skew_mean_ms", mean_ms);
+            report(path, decimation, "first_pitch_skew_max_ms", max_ms);
+        }
+    }
+    return EXIT_SUCCESS;
+}
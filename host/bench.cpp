@@ -0,0 +1,2298 @@
+// Host benchmarks for the DSP building blocks.
+//
+// Usage: terrarium-bench [suite...]
+//        terrarium-bench --update-golden
+//        terrarium-bench --compare OLD NEW
+//
+// Runs every suite when none are named. Each result is printed as one
+// tab-separated line: suite, case, metric, value.
+//
+// --update-golden records the golden suite's outputs as the new reference.
+// --compare reads two saved runs and prints the change in each timing, so
+// runs from two commits can be set side by side.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+#include <q/support/phase.hpp>
+
+#include <util/EffectState.h>
+#include <util/FlashQueue.h>
+#include <util/LatencyProbe.h>
+#include <util/Fft.h>
+#include <util/LinearRamp.h>
+#include <util/Mapping.h>
+#include <util/ModMatrix.h>
+#include <util/NoiseSynth.h>
+#include <util/PresetBank.h>
+#include <util/SampleCounter.h>
+#include <util/Scheduler.h>
+#include <util/SlotLog.h>
+#include <util/Snapshot.h>
+#include <util/SvFilter.h>
+#include <util/SvFilterBank.h>
+#include <util/SynthEngine.h>
+#include <util/TapTempo.h>
+#include <util/Telemetry.h>
+#include <util/WaveSynth.h>
+#include <util/VoicePool.h>
+#include <util/WaveTable.h>
+
+#include "SimTerrarium.h"
+
+namespace q = cycfi::q;
+
+namespace
+{
+
+constexpr float sample_rate = 48000;
+
+// Keeps the optimizer from discarding benchmark results.
+volatile float sink = 0;
+
+void report(const char* suite, const char* name, const char* metric, double value)
+{
+    std::printf("%s\t%s\t%s\t%.4g\n", suite, name, metric, value);
+}
+
+// Returns the average time per call of fn, in nanoseconds: the best of
+// three runs, so one disturbed by the rest of the machine doesn't count.
+template <typename F>
+double nsPerCall(F&& fn, size_t calls)
+{
+    using clock = std::chrono::steady_clock;
+    fn(calls / 10); // warm up
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; ++run)
+    {
+        const auto start = clock::now();
+        fn(calls);
+        const std::chrono::duration<double, std::nano> elapsed =
+            clock::now() - start;
+        best = std::min(best, elapsed.count() / calls);
+    }
+    return best;
+}
+
+// Ratio of energy away from the harmonics of frequency to the energy on
+// them, in dB. Measured over a Blackman-Harris windowed FFT.
+double aliasLevel(const std::vector<float>& signal, float frequency)
+{
+    constexpr auto two_pi = 2 * std::numbers::pi;
+    const auto size = signal.size();
+    std::vector<std::complex<double>> spectrum(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        const auto x = two_pi * i / size;
+        const auto window = 0.35875 - 0.48829 * std::cos(x) +
+            0.14128 * std::cos(2 * x) - 0.01168 * std::cos(3 * x);
+        spectrum[i] = signal[i] * window;
+    }
+    fft(spectrum.data(), size);
+
+    constexpr double guard_bins = 6;
+    const auto bin_hz = sample_rate / size;
+    double harmonic = 0;
+    double alias = 0;
+    for (size_t bin = 1; bin < size / 2; ++bin)
+    {
+        const auto power = std::norm(spectrum[bin]);
+        const auto hz = bin * bin_hz;
+        const auto nearest = std::round(hz / frequency) * frequency;
+        const bool on_harmonic =
+            (std::abs(hz - nearest) <= guard_bins * bin_hz);
+        if (on_harmonic && nearest == 0) { continue; } // DC
+        (on_harmonic ? harmonic : alias) += power;
+    }
+    return 10 * std::log10(alias / harmonic);
+}
+
+template <typename Osc>
+std::vector<float> render(const Osc& osc, float frequency, size_t size)
+{
+    std::vector<float> out(size);
+    q::phase_iterator phase;
+    phase.set(frequency, sample_rate);
+    for (auto& x : out)
+    {
+        x = osc.compensated(phase);
+        phase++;
+    }
+    return out;
+}
+
+template <typename Osc, typename Setup>
+void benchOscillator(const char* name, Osc& osc, Setup&& setup)
+{
+    constexpr float shapes[] = {0, 0.5, 1, 2, 2.5, 3};
+    constexpr float frequencies[] = {110, 440, 1397};
+    constexpr size_t calls = 1 << 22;
+    char label[96];
+
+    for (const auto shape : shapes)
+    {
+        setup(osc, shape, 440.0f);
+        const auto ns = nsPerCall([&](size_t n) {
+            q::phase_iterator phase;
+            phase.set(440.0f, sample_rate);
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                sum += osc.compensated(phase);
+                phase++;
+            }
+            sink = sum;
+        }, calls);
+        std::snprintf(label, sizeof(label), "%s shape=%.1f", name, shape);
+        report("wave", label, "ns/sample", ns);
+
+        for (const auto frequency : frequencies)
+        {
+            setup(osc, shape, frequency);
+            const auto signal = render(osc, frequency, 1 << 15);
+            std::snprintf(label, sizeof(label), "%s shape=%.1f f=%.0f",
+                name, shape, frequency);
+            report("wave", label, "alias_db", aliasLevel(signal, frequency));
+        }
+    }
+}
+
+template <size_t Size, size_t Levels, size_t ShapesPerUnit>
+void benchWaveTable()
+{
+    using Table = WaveTable<Size, Levels, ShapesPerUnit>;
+    static typename Table::Tables tables;
+    Table::generate(tables);
+    Table table(tables);
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "table%zux%zux%zu",
+        Size, Levels, ShapesPerUnit);
+    report("wave", name, "bytes", Table::memory_size);
+    benchOscillator(name, table, [](Table& t, float shape, float frequency) {
+        t.setShape(shape);
+        t.setFrequency(frequency, sample_rate);
+    });
+}
+
+void benchWave()
+{
+    WaveSynth synth;
+    benchOscillator("WaveSynth", synth, [](WaveSynth& s, float shape, float) {
+        s.setShape(shape);
+    });
+
+    benchWaveTable<256, 8, 4>();
+    benchWaveTable<512, 8, 2>();
+    benchWaveTable<512, 8, 4>();
+    benchWaveTable<1024, 8, 4>();
+}
+
+void benchFilter()
+{
+    constexpr size_t calls = 1 << 22;
+    constexpr float q = 2;
+
+    // A corner sweep from 50 Hz to 20 kHz and back, one step per sample.
+    std::vector<float> corners(4096);
+    for (size_t i = 0; i < corners.size(); ++i)
+    {
+        const auto x = std::abs(2.0f * i / corners.size() - 1);
+        corners[i] = 50 * std::pow(400.0f, x);
+    }
+    const auto mask = corners.size() - 1;
+
+    SvFilter filter(1000, sample_rate, q);
+    report("filter", "update", "ns/sample", nsPerCall([&](size_t n) {
+        for (size_t i = 0; i < n; ++i)
+        {
+            filter.update(corners[i & mask] * 1e-4f);
+        }
+        sink = filter.lowPass();
+    }, calls));
+
+    report("filter", "config+update", "ns/sample", nsPerCall([&](size_t n) {
+        for (size_t i = 0; i < n; ++i)
+        {
+            filter.config(corners[i & mask], sample_rate, q);
+            filter.update(corners[i & mask] * 1e-4f);
+        }
+        sink = filter.lowPass();
+    }, calls));
+
+    const auto period = 1 / sample_rate;
+    filter.setResonance(q);
+    report("filter", "tune+update", "ns/sample", nsPerCall([&](size_t n) {
+        for (size_t i = 0; i < n; ++i)
+        {
+            filter.tune(corners[i & mask] * period);
+            filter.update(corners[i & mask] * 1e-4f);
+        }
+        sink = filter.lowPass();
+    }, calls));
+
+    SvFilter low_pass(1000, sample_rate, q);
+    SvFilter high_pass(1000, sample_rate, q);
+    report("filter", "lp+hp SvFilter", "ns/sample", nsPerCall([&](size_t n) {
+        for (size_t i = 0; i < n; ++i)
+        {
+            low_pass.update(corners[i & mask] * 1e-4f);
+            high_pass.update(corners[i & mask] * 1e-4f);
+        }
+        sink = low_pass.lowPass() + high_pass.highPass();
+    }, calls));
+
+    for (size_t stages = 1; stages <= SvCascade::max_stages; ++stages)
+    {
+        SvFilterBank bank;
+        bank.setStages(stages);
+        bank.setResonance(q);
+        bank.tune(1000 * period, 1000 * period);
+        char name[32];
+        std::snprintf(name, sizeof(name), "bank %zu stage", stages);
+        report("filter", name, "ns/sample", nsPerCall([&](size_t n) {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                sum += bank.process(corners[i & mask] * 1e-4f);
+            }
+            sink = sum;
+        }, calls));
+    }
+
+    double max_error = 0;
+    for (int i = 1; i <= 100000; ++i)
+    {
+        const auto f = SvFilterTuning::max_corner * i / 100000.0;
+        const auto exact = std::tan(std::numbers::pi * f);
+        const auto error = std::abs(SvFilterTuning::k(f) - exact) / exact;
+        max_error = std::max(max_error, error);
+    }
+    report("filter", "tuning table", "max_rel_error", max_error);
+}
+
+// The small building blocks: time per call across the range of each
+// parameter. WaveSynth and SvFilter are in the wave and filter suites.
+void benchUnits()
+{
+    constexpr size_t calls = 1 << 22;
+    char name[48];
+
+    for (const int duration : {1, 8, 64})
+    {
+        NoiseSynth noise;
+        noise.setSampleDuration(duration);
+        std::snprintf(name, sizeof(name), "NoiseSynth duration=%d", duration);
+        report("units", name, "ns/sample", nsPerCall([&](size_t n) {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i) { sum += noise(); }
+            sink = sum;
+        }, calls));
+    }
+
+    // Back and forth between targets it takes steps samples to reach
+    for (const int steps : {1, 100, 10000})
+    {
+        LinearRamp ramp(0, 1.0f / steps);
+        std::snprintf(name, sizeof(name), "LinearRamp steps=%d", steps);
+        report("units", name, "ns/call", nsPerCall([&](size_t n) {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                sum += ramp(((i / steps) & 1) ? 0.0f : 1.0f);
+            }
+            sink = sum;
+        }, calls));
+
+        BlockRamp block_ramp;
+        std::snprintf(name, sizeof(name), "BlockRamp samples=%d", steps);
+        report("units", name, "ns/call", nsPerCall([&](size_t n) {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (!block_ramp.ramping())
+                {
+                    block_ramp.setTarget(1 - block_ramp.target(), steps);
+                }
+                sum += block_ramp();
+            }
+            sink = sum;
+        }, calls));
+    }
+
+    // Knob sweeps over part of the range and all of it
+    constexpr LinearMapping linear(64, 3200);
+    constexpr LogMapping log(2, 200);
+    constexpr LogMapping log_centered(0, 6, 49);
+    for (const float span : {0.01f, 1.0f})
+    {
+        const auto sweep = [&](const char* mapping, auto&& map) {
+            std::snprintf(name, sizeof(name), "%s span=%.2f", mapping, span);
+            report("units", name, "ns/call", nsPerCall([&](size_t n) {
+                float sum = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    sum += map(span * (i & 1023) / 1023.0f);
+                }
+                sink = sum;
+            }, calls));
+        };
+        sweep("LinearMapping", linear);
+        sweep("LogMapping", log);
+        sweep("LogMapping centered", log_centered);
+    }
+
+    // The switch task's calls, once a millisecond
+    for (const uint32_t interval : {100u, 1000u, 2000u})
+    {
+        TapTempo tempo(interval, 2000);
+        std::snprintf(name, sizeof(name), "TapTempo interval=%u",
+            static_cast<unsigned>(interval));
+        report("units", name, "ns/call", nsPerCall([&](size_t n) {
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                tempo.Update(static_cast<uint32_t>(i));
+                sum += tempo.Ratio();
+            }
+            sink = sum;
+        }, calls));
+    }
+
+    EffectState a;
+    EffectState b;
+    b.setRatios({1, 1, 1, 1, 1, 1, 1});
+    report("units", "EffectState blended", "ns/call", nsPerCall([&](size_t n) {
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            sum += blended(a, b, (i & 1023) / 1023.0f).waveShape();
+        }
+        sink = sum;
+    }, calls));
+}
+
+// The knob curves EffectState uses, as the tables would hold them
+struct Curve
+{
+    const char* name;
+    LogMapping mapping;
+};
+
+constexpr Curve curves[] = {
+    {"level 0-1-20", LogMapping(0, 1, EffectState::max_level)},
+    {"low pass 2-200", LogMapping(2, 200)},
+    {"high pass 0-6-49", LogMapping(0, 6, 49)},
+    {"resonance 0.707-6", LogMapping(0.707, 6)},
+};
+
+// Largest error of map against the curve's exact values, relative to
+// the exact value, but at least 1% of the curve's span so that values
+// near zero don't dominate.
+template <typename Map>
+double maxMappingError(const Curve& curve, const Map& map)
+{
+    constexpr int points = 100000;
+    const auto span = std::abs(curve.mapping.exact(1) -
+        curve.mapping.exact(0));
+    double max_error = 0;
+    for (int i = 0; i <= points; ++i)
+    {
+        const auto x = static_cast<float>(i) / points;
+        const double exact = curve.mapping.exact(x);
+        const auto scale = std::max(std::abs(exact), 0.01 * span);
+        max_error = std::max(max_error, std::abs(map(x) - exact) / scale);
+    }
+    return max_error;
+}
+
+template <size_t N>
+void benchTableMapping()
+{
+    char name[48];
+    std::snprintf(name, sizeof(name), "TableMapping<%zu>", N);
+    report("mapping", name, "bytes", TableMapping<N>::memory_size);
+
+    double worst = 0;
+    for (const auto& curve : curves)
+    {
+        const TableMapping<N> table(curve.mapping);
+        worst = std::max(worst, maxMappingError(curve, table));
+    }
+    report("mapping", name, "max error %", 100 * worst);
+
+    const TableMapping<N> table(curves[0].mapping);
+    report("mapping", name, "ns/call", nsPerCall([&](size_t n) {
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i) { sum += table((i & 1023) / 1023.0f); }
+        sink = sum;
+    }, 1 << 22));
+}
+
+// Table sizes against LogMapping's fasterexp, for accuracy and speed.
+// Errors are the worst over the curves EffectState maps its knobs with.
+void benchMapping()
+{
+    double worst = 0;
+    for (const auto& curve : curves)
+    {
+        worst = std::max(worst, maxMappingError(curve, curve.mapping));
+    }
+    report("mapping", "LogMapping", "max error %", 100 * worst);
+    const auto& log = curves[0].mapping;
+    report("mapping", "LogMapping", "ns/call", nsPerCall([&](size_t n) {
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i) { sum += log((i & 1023) / 1023.0f); }
+        sink = sum;
+    }, 1 << 22));
+
+    benchTableMapping<8>();
+    benchTableMapping<16>();
+    benchTableMapping<32>();
+    benchTableMapping<64>();
+    benchTableMapping<128>();
+    benchTableMapping<256>();
+}
+
+#ifndef TERRARIUM_GOLDEN_FILE
+#define TERRARIUM_GOLDEN_FILE "host/golden.tsv"
+#endif
+
+// Set by --update-golden
+bool update_golden = false;
+
+// Reference outputs for the golden suite, one "case, metric, value" line
+// each, recorded with --update-golden.
+std::map<std::string, double> loadGolden(const char* path)
+{
+    std::map<std::string, double> values;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const auto tab = line.rfind('\t');
+        if (tab == std::string::npos) { continue; }
+        values[line.substr(0, tab)] = std::strtod(line.c_str() + tab + 1,
+            nullptr);
+    }
+    return values;
+}
+
+// Summarizes a component's output as metrics, which the golden suite
+// compares with the recorded ones: the mean and RMS, the waveform at every
+// 64th sample, or often enough for 16 points in a short output, and the
+// RMS and zero crossings of each eighth of a longer one.
+struct Fingerprint
+{
+    static constexpr size_t max_stride = 64;
+    static constexpr size_t min_points = 16;
+    static constexpr size_t segments = 8;
+    // Smaller samples don't count toward zero crossings, so rounding at
+    // zero doesn't add or remove one.
+    static constexpr float crossing_threshold = 1e-4f;
+
+    std::vector<std::pair<std::string, double>> values;
+
+    void add(const char* name, const std::vector<float>& out)
+    {
+        const auto [mean, rms, crossings] = summary(out.begin(), out.end());
+        add(name, "mean", mean);
+        add(name, "rms", rms);
+
+        char metric[32];
+        const auto stride =
+            std::clamp<size_t>(out.size() / min_points, 1, max_stride);
+        for (size_t i = 0; i < out.size(); i += stride)
+        {
+            std::snprintf(metric, sizeof(metric), "at %zu", i);
+            add(name, metric, out[i]);
+        }
+        add(name, "last", out.back());
+
+        // Every sample is in already.
+        if (stride == 1) { return; }
+        for (size_t s = 0; s < segments; ++s)
+        {
+            const auto begin = s * out.size() / segments;
+            const auto end = (s + 1) * out.size() / segments;
+            const auto segment =
+                summary(out.begin() + begin, out.begin() + end);
+            std::snprintf(metric, sizeof(metric), "rms %zu-%zu", begin,
+                end - 1);
+            add(name, metric, std::get<1>(segment));
+            std::snprintf(metric, sizeof(metric), "crossings %zu-%zu",
+                begin, end - 1);
+            add(name, metric, std::get<2>(segment));
+        }
+    }
+
+    void add(const char* name, const char* metric, double value)
+    {
+        values.emplace_back(std::string(name) + '\t' + metric, value);
+    }
+
+    // Mean, RMS and zero crossings
+    template <typename Iterator>
+    static std::tuple<double, double, size_t> summary(
+        Iterator begin, Iterator end)
+    {
+        double sum = 0;
+        double sum_sq = 0;
+        size_t crossings = 0;
+        int sign = 0;
+        for (auto it = begin; it != end; ++it)
+        {
+            const auto x = *it;
+            sum += x;
+            sum_sq += x * x;
+            if (std::abs(x) < crossing_threshold) { continue; }
+            const int s = (x > 0) ? 1 : -1;
+            crossings += (sign != 0 && s != sign);
+            sign = s;
+        }
+        const auto size = static_cast<double>(end - begin);
+        return {sum / size, std::sqrt(sum_sq / size), crossings};
+    }
+};
+
+// Runs each component through a fixed input and compares the result with
+// the recorded one. Fails on any value further from the recording than
+// float rounding would explain.
+void benchGolden()
+{
+    Fingerprint print;
+    char name[48];
+
+    // Phase steps that don't divide the cycle evenly
+    constexpr q::phase step(0x01234567u);
+    for (const float shape : {0.0f, 0.5f, 1.0f, 1.5f, 2.0f, 2.5f, 3.0f})
+    {
+        const WaveSynth synth(shape);
+        std::vector<float> out(1024);
+        q::phase phase;
+        for (auto& x : out)
+        {
+            x = synth.compensated(phase);
+            phase += step;
+        }
+        std::snprintf(name, sizeof(name), "WaveSynth shape=%.1f", shape);
+        print.add(name, out);
+    }
+
+    // An impulse, then a falling sawtooth
+    std::vector<float> input(2048);
+    input[0] = 1;
+    for (size_t i = 1; i < input.size(); ++i)
+    {
+        input[i] = 1 - (2 * static_cast<float>(i % 100) / 100);
+    }
+    for (const auto& [corner, resonance] :
+        {std::pair{0.02f, 0.707f}, std::pair{0.2f, 4.0f}})
+    {
+        SvFilter filter;
+        filter.setResonance(resonance);
+        filter.tune(corner);
+        std::vector<float> low(input.size());
+        std::vector<float> band(input.size());
+        std::vector<float> high(input.size());
+        for (size_t i = 0; i < input.size(); ++i)
+        {
+            filter.update(input[i]);
+            low[i] = filter.lowPass();
+            band[i] = filter.bandPass();
+            high[i] = filter.highPass();
+        }
+        const auto add = [&](const char* output, const auto& out) {
+            std::snprintf(name, sizeof(name), "SvFilter f=%.2f q=%.3g %s",
+                corner, resonance, output);
+            print.add(name, out);
+        };
+        add("low", low);
+        add("band", band);
+        add("high", high);
+    }
+
+    // The generator is q's, so only the hold pattern is checked.
+    for (const int duration : {1, 4, 37})
+    {
+        NoiseSynth noise;
+        noise.setSampleDuration(duration);
+        float last = noise();
+        int changes = 0;
+        for (int i = 1; i < 4096; ++i)
+        {
+            const auto x = noise();
+            changes += x != last;
+            last = x;
+        }
+        std::snprintf(name, sizeof(name), "NoiseSynth duration=%d", duration);
+        print.add(name, "changes", changes);
+    }
+
+    {
+        LinearRamp ramp(0, 0.013f);
+        std::vector<float> out(300);
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            out[i] = ramp((i < 120) ? 1.0f : -0.5f);
+        }
+        print.add("LinearRamp", out);
+
+        BlockRamp block_ramp;
+        std::vector<float> block_out;
+        for (const auto& [target, samples] :
+            {std::pair{1.0f, 48}, std::pair{-0.25f, 7}, std::pair{0.6f, 100}})
+        {
+            block_ramp.setTarget(target, samples);
+            for (int i = 0; i < 60; ++i) { block_out.push_back(block_ramp()); }
+        }
+        print.add("BlockRamp", block_out);
+    }
+
+    {
+        using Shape = LfoSettings::Shape;
+        constexpr std::pair<Shape, const char*> shapes[] = {
+            {Shape::sine, "sine"}, {Shape::triangle, "triangle"},
+            {Shape::ramp, "ramp"}, {Shape::sample_hold, "sample_hold"}};
+        for (const auto& [shape, shape_name] : shapes)
+        {
+            for (const bool cycle : {true, false})
+            {
+                Lfo lfo;
+                lfo.set({shape, 7.3f, cycle, true}, sample_rate);
+                std::vector<float> out(1000);
+                for (size_t i = 0; i < out.size(); ++i)
+                {
+                    // Restarts two thirds of the way through
+                    out[i] = lfo.advance(16, (i == 666) ? 5 : 16);
+                }
+                std::snprintf(name, sizeof(name), "Lfo %s %s", shape_name,
+                    cycle ? "cycle" : "one-shot");
+                print.add(name, out);
+            }
+        }
+    }
+
+    {
+        std::vector<float> x(101);
+        for (size_t i = 0; i < x.size(); ++i) { x[i] = i / 100.0f; }
+        const auto sweep = [&](const char* mapping, auto&& map) {
+            std::vector<float> out(x.size());
+            std::transform(x.begin(), x.end(), out.begin(), map);
+            print.add(mapping, out);
+        };
+        sweep("LinearMapping 64-3200", LinearMapping(64, 3200));
+        sweep("LogMapping 2-200", LogMapping(2, 200));
+        sweep("LogMapping 0-6-49", LogMapping(0, 6, 49));
+    }
+
+    {
+        // Taps 500 ms apart, then 300, then one too late to count
+        TapTempo tempo(1000, 2000);
+        std::vector<float> ratios;
+        std::vector<float> intervals;
+        uint32_t now = 0;
+        for (const uint32_t gap : {500u, 500u, 300u, 300u, 2500u})
+        {
+            for (uint32_t t = 0; t < gap; t += 50)
+            {
+                tempo.Update(now + t);
+                ratios.push_back(tempo.Ratio());
+            }
+            now += gap;
+            tempo.Update(now);
+            tempo.Tap();
+            intervals.push_back(static_cast<float>(tempo.Interval()));
+        }
+        print.add("TapTempo ratio", ratios);
+        print.add("TapTempo interval", intervals);
+    }
+
+    {
+        EffectState a;
+        a.setRatios({0.1f, 0.9f, 0.2f, 0.3f, 0.8f, 0, 1});
+        EffectState b;
+        b.setRatios({0.7f, 0.2f, 1, 0.9f, 0.1f, 1, 0});
+        std::vector<float> out;
+        for (int i = 0; i <= 10; ++i)
+        {
+            const auto s = blended(a, b, i / 10.0f);
+            const auto r = s.ratios();
+            out.insert(out.end(), r.begin(), r.end());
+            out.push_back(s.dryLevel());
+            out.push_back(s.waveShape());
+            out.push_back(s.lowPassCorner(110, sample_rate));
+            out.push_back(s.highPassCorner(110, sample_rate));
+        }
+        print.add("EffectState blended", out);
+    }
+
+    if (update_golden)
+    {
+        auto* file = std::fopen(TERRARIUM_GOLDEN_FILE, "w");
+        if (!file)
+        {
+            std::fprintf(stderr, "golden: can't write %s\n",
+                TERRARIUM_GOLDEN_FILE);
+            std::exit(EXIT_FAILURE);
+        }
+        for (const auto& [key, value] : print.values)
+        {
+            std::fprintf(file, "%s\t%.9g\n", key.c_str(), value);
+        }
+        std::fclose(file);
+        report("golden", "all", "recorded", print.values.size());
+        return;
+    }
+
+    const auto golden = loadGolden(TERRARIUM_GOLDEN_FILE);
+    size_t drifted = 0;
+    for (const auto& [key, value] : print.values)
+    {
+        const auto tab = key.find('\t');
+        const auto case_name = key.substr(0, tab);
+        const auto metric = key.substr(tab + 1);
+        report("golden", case_name.c_str(), metric.c_str(), value);
+
+        const auto expected = golden.find(key);
+        const bool missing = (expected == golden.end());
+        const auto tolerance = missing ? 0 :
+            std::max(1e-5, 1e-4 * std::abs(expected->second));
+        if (missing || std::abs(value - expected->second) > tolerance)
+        {
+            std::fprintf(stderr, "golden: %s %s is %.9g, recorded %s\n",
+                case_name.c_str(), metric.c_str(), value,
+                missing ? "nothing" :
+                    std::to_string(expected->second).c_str());
+            drifted++;
+        }
+    }
+    report("golden", "all", "drifted", drifted);
+    if (drifted > 0)
+    {
+        std::fprintf(stderr, "golden: outputs differ from %s; if the change "
+            "is intended, run with --update-golden\n", TERRARIUM_GOLDEN_FILE);
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+void benchVoices()
+{
+    constexpr size_t calls = 1 << 20;
+    constexpr size_t block_size = 48;
+    static WaveTable<>::Tables tables;
+    WaveTable<>::generate(tables);
+    WaveTable<> table(tables);
+
+    std::vector<float> out(block_size);
+    std::vector<double> ns(Harmony::max_voices + 1);
+    Harmony harmony;
+    harmony.count = 0;
+    for (size_t count = 1; count <= Harmony::max_voices; ++count)
+    {
+        harmony.add({static_cast<float>(count - 1), 3, 1});
+        VoicePool voices;
+        voices.setHarmony(harmony);
+        voices.setFrequency(220, sample_rate);
+        ns[count] = nsPerCall([&](size_t n) {
+            for (size_t i = 0; i < n; i += block_size)
+            {
+                voices.render(table, out.data(), block_size, 1);
+            }
+            sink = out[0];
+        }, calls);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%zu voices", count);
+        report("voices", name, "ns/sample", ns[count]);
+    }
+
+    // The cost of each voice beyond the first, and how many voices alone
+    // would fill the real-time budget at 48 kHz on this machine.
+    const auto per_voice =
+        (ns[Harmony::max_voices] - ns[1]) / (Harmony::max_voices - 1);
+    report("voices", "per voice", "ns/sample", per_voice);
+    report("voices", "budget", "voices_at_48k",
+        std::floor((1e9 / sample_rate) / per_voice));
+}
+
+// A note every quarter second, decaying, up an octave and back
+std::vector<float> pluckedNotes(size_t length, float rate = sample_rate)
+{
+    std::vector<float> notes(length);
+    const auto note_length = static_cast<size_t>(rate / 4);
+    for (size_t i = 0; i < length; ++i)
+    {
+        const auto note = i / note_length;
+        const auto t = static_cast<float>(i % note_length) / rate;
+        const auto frequency = 110 * std::exp2((note % 13) / 12.0f);
+        notes[i] = 0.5f * std::exp(-6 * t) *
+            std::sin(2 * std::numbers::pi_v<float> * frequency * t);
+    }
+    return notes;
+}
+
+// Knob settings with the synth, envelope and a resonant filter in play
+EngineParams synthParams()
+{
+    EngineParams params;
+    params.enable_effect = true;
+    params.interface_state.setDryRatio(0.5);
+    params.interface_state.setSynthRatio(0.7);
+    params.interface_state.setWaveRatio(0.4);
+    params.interface_state.setFilterRatio(0.3);
+    params.interface_state.setResonanceRatio(0.3);
+    params.interface_state.setEnvelopeEnabled(true);
+    return params;
+}
+
+// Time per sample to run the engine over input in blocks of block_size,
+// best of three runs from a fresh engine each time. The output of the last
+// run is left in kept, if given.
+double engineNsPerSample(const std::vector<float>& input,
+    const EngineParams& params, size_t block_size,
+    float rate = sample_rate, std::vector<float>* kept = nullptr)
+{
+    const auto length = input.size();
+    std::vector<float> output(length);
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; ++run)
+    {
+        SynthEngine engine(rate);
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < length; i += block_size)
+        {
+            const auto size = std::min(block_size, length - i);
+            engine.process(input.data() + i, output.data() + i, size,
+                params, i);
+        }
+        const std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / length);
+    }
+    sink = output[length / 2];
+    if (kept) { *kept = std::move(output); }
+    return best;
+}
+
+// The whole engine at each block size, on plucked notes, as a share of
+// real time at 48 kHz on this machine. Also checks the latency probe
+// through a simulated loopback: the output block is played while the next
+// one is computed, and the input arrives a block after it was recorded, so
+// the round trip is two blocks plus the converters.
+void benchBlocks()
+{
+    constexpr size_t block_sizes[] = {1, 2, 4, 8, 16, 32, 48, 96};
+    constexpr size_t seconds = 4;
+    constexpr size_t length = seconds * static_cast<size_t>(sample_rate);
+
+    const auto input = pluckedNotes(length);
+    const auto params = synthParams();
+
+    char name[32];
+    for (const auto block_size : block_sizes)
+    {
+        const auto ns = engineNsPerSample(input, params, block_size);
+        std::snprintf(name, sizeof(name), "block %zu", block_size);
+        report("blocks", name, "ns/sample", ns);
+        report("blocks", name, "cpu %", 100 * ns * sample_rate / 1e9);
+    }
+
+    // Stands in for the converters' own delay
+    constexpr size_t converter_delay = 20;
+    bool failed = false;
+    for (const auto block_size : block_sizes)
+    {
+        LatencyProbe probe(4800);
+        const auto delay = 2 * block_size + converter_delay;
+        std::vector<float> line(delay + block_size, 0.0f);
+        std::vector<float> in(block_size);
+        std::vector<float> out(block_size);
+        size_t write = 0;
+        for (size_t i = 0; i < length; i += block_size)
+        {
+            for (size_t j = 0; j < block_size; ++j)
+            {
+                in[j] = line[(write + j) % line.size()];
+            }
+            probe.process(in.data(), out.data(), block_size);
+            for (size_t j = 0; j < block_size; ++j)
+            {
+                line[(write + j + delay) % line.size()] = out[j];
+            }
+            write = (write + block_size) % line.size();
+        }
+
+        std::snprintf(name, sizeof(name), "block %zu", block_size);
+        report("blocks", name, "round trip ms",
+            probe.max() * 1000 / sample_rate);
+        failed |= probe.count() == 0 || probe.lost() != 0 ||
+            probe.min() != delay || probe.max() != delay;
+    }
+
+    if (failed)
+    {
+        std::fprintf(stderr, "blocks: latency probe measured wrongly\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// The engine with its oscillator and filter oversampled by 1, 2 and 4, and
+// the decimator on its own. Also measures the decimator's response: the
+// gain at the top of the audio band, and how far tones that would fold
+// back into it are pushed down.
+void benchOversampling()
+{
+    constexpr size_t length = 4 * static_cast<size_t>(sample_rate);
+    const auto input = pluckedNotes(length);
+    auto params = synthParams();
+    params.interface_state.setNoiseEnabled(true);
+
+    char name[32];
+    for (const size_t factor : {1, 2, 4})
+    {
+        params.oversampling = factor;
+        std::snprintf(name, sizeof(name), "%zux", factor);
+        const auto ns = engineNsPerSample(input, params, 48);
+        report("oversampling", name, "engine ns/sample", ns);
+
+        OversamplingDecimator decimator;
+        decimator.setFactor(factor);
+        std::vector<float> high(48 * factor, 0.25f);
+        std::vector<float> low(48);
+        report("oversampling", name, "decimator ns/sample",
+            nsPerCall([&](size_t n) {
+                for (size_t i = 0; i < n; i += low.size())
+                {
+                    decimator.process(high.data(), low.data(), low.size());
+                }
+                sink = low[0];
+            }, 1 << 20));
+
+        // Gain in dB of a tone at frequency, at the oversampled rate
+        const auto gain = [&](float frequency) {
+            decimator.setFactor(factor);
+            const auto rate = sample_rate * factor;
+            constexpr size_t out_length = 1 << 14;
+            std::vector<float> tone(out_length * factor);
+            for (size_t i = 0; i < tone.size(); ++i)
+            {
+                tone[i] = std::sin(
+                    2 * std::numbers::pi_v<float> * frequency * i / rate);
+            }
+            std::vector<float> out(out_length);
+            decimator.process(tone.data(), out.data(), out_length);
+            double power = 0;
+            for (size_t i = out_length / 2; i < out_length; ++i)
+            {
+                power += out[i] * out[i];
+            }
+            return 10 * std::log10(power / (out_length / 2) / 0.5);
+        };
+        if (factor == 1) { continue; }
+        report("oversampling", name, "gain 16k dB", gain(16000));
+        report("oversampling", name, "gain 20k dB", gain(20000));
+        // These fold back to 20 kHz and 10 kHz.
+        report("oversampling", name, "gain 28k dB", gain(28000));
+        report("oversampling", name, "gain 38k dB", gain(38000));
+    }
+}
+
+// The engine at each sample rate the pedal can boot into, plain and
+// oversampled, in blocks of 48: the time per sample, the share of real time
+// at that rate, and how long a block lasts. Also checks that the blend
+// into modulation takes as long at every rate, which it wouldn't if its
+// ramp were still counted in control updates.
+void benchRates()
+{
+    constexpr float rates[] = {32000, 48000, 96000};
+    constexpr size_t block_size = 48;
+    constexpr float seconds = 4;
+    auto params = synthParams();
+
+    char name[32];
+    for (const size_t factor : {1, 2, 4})
+    {
+        params.oversampling = factor;
+        for (const auto rate : rates)
+        {
+            const auto input = pluckedNotes(
+                static_cast<size_t>(seconds * rate), rate);
+            const auto ns = engineNsPerSample(input, params, block_size,
+                rate);
+            std::snprintf(name, sizeof(name), "%.0fk %zux", rate / 1000,
+                factor);
+            report("rates", name, "ns/sample", ns);
+            report("rates", name, "cpu %", 100 * ns * rate / 1e9);
+            report("rates", name, "block ms", 1000 * block_size / rate);
+        }
+    }
+
+    // A blend over 1 ms is held back to the modulation ramp.
+    EngineParams mod_params;
+    mod_params.enable_effect = true;
+    mod_params.apply_mod = true;
+    mod_params.mod_duration = 1;
+    std::vector<double> fades;
+    for (const auto rate : rates)
+    {
+        SynthEngine engine(rate);
+        std::vector<float> in(block_size);
+        std::vector<float> out(block_size);
+        size_t time = 0;
+        while (engine.status().mod_ratio < 1 && time < rate)
+        {
+            engine.process(in.data(), out.data(), block_size, mod_params,
+                time);
+            time += block_size;
+        }
+        fades.push_back(1000 * time / rate);
+        std::snprintf(name, sizeof(name), "%.0fk", rate / 1000);
+        report("rates", name, "mod fade ms", fades.back());
+    }
+
+    // Within a block at the lowest rate
+    const auto [shortest, longest] = std::ranges::minmax(fades);
+    if (longest - shortest > 1000 * block_size / rates[0])
+    {
+        std::fprintf(stderr, "rates: the modulation fade depends on the "
+            "sample rate\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Settings with the first count of eight routes, spread over every
+// destination and source
+ModSettings modRoutes(size_t count)
+{
+    using Source = ModSource;
+    using Destination = ModDestination;
+    constexpr ModRoute routes[] = {
+        {Source::lfo1, Destination::filter, 1.5f},
+        {Source::lfo2, Destination::shape, -1},
+        {Source::envelope, Destination::dry_level, 0.5f},
+        {Source::lfo1, Destination::synth_level, -0.5f},
+        {Source::lfo2, Destination::noise_rate, 2},
+        {Source::envelope, Destination::filter, -1},
+        {Source::lfo2, Destination::filter, 0.5f},
+        {Source::lfo1, Destination::shape, 0.5f},
+    };
+
+    ModSettings settings;
+    settings.lfos[0] = {LfoSettings::Shape::sine, 3, true, true};
+    settings.lfos[1] = {LfoSettings::Shape::sample_hold, 7, true, false};
+    for (size_t r = 0; r < count; ++r) { settings.add(routes[r]); }
+    return settings;
+}
+
+// The mod matrix on its own and in the engine, with 1, 4 and 8 routes.
+// Also checks that an LFO lands on the same phase however a span is split
+// into calls, with and without a restart part way.
+void benchMod()
+{
+    constexpr size_t length = 4 * static_cast<size_t>(sample_rate);
+    const auto input = pluckedNotes(length);
+    auto params = synthParams();
+    params.interface_state.setNoiseEnabled(true);
+    report("mod", "routes 0", "engine ns/sample",
+        engineNsPerSample(input, params, 48));
+
+    std::vector<float> envelope(ModMatrix::max_block_size, 0.5f);
+    char name[32];
+    for (const size_t count : {1, 4, 8})
+    {
+        std::snprintf(name, sizeof(name), "routes %zu", count);
+        ModMatrix matrix(sample_rate);
+        matrix.set(modRoutes(count));
+        report("mod", name, "matrix ns/block", nsPerCall([&](size_t n) {
+            for (size_t i = 0; i < n; ++i)
+            {
+                matrix.process(ModMatrix::max_block_size,
+                    (i % 50 == 0) ? 20 : ModMatrix::max_block_size,
+                    envelope.data());
+            }
+            sink = matrix.values(ModDestination::filter)[0];
+        }, 1 << 20));
+
+        params.mod = modRoutes(count);
+        report("mod", name, "engine ns/sample",
+            engineNsPerSample(input, params, 48));
+    }
+
+    bool failed = false;
+    for (const auto shape : {LfoSettings::Shape::sine,
+        LfoSettings::Shape::triangle, LfoSettings::Shape::ramp})
+    {
+        for (const bool cycle : {true, false})
+        {
+            const LfoSettings settings{shape, 13.7f, cycle, true};
+            Lfo whole;
+            Lfo split;
+            whole.set(settings, sample_rate);
+            split.set(settings, sample_rate);
+
+            // Runs of 1 to 64 samples, restarting 10 samples in every
+            // fifth one
+            for (size_t run = 0; run < 2000; ++run)
+            {
+                const auto samples = 1 + ((run * 37) % 64);
+                const auto restart_at = (run % 5 == 0) ? 10 : samples;
+                for (size_t i = 0; i < samples; ++i)
+                {
+                    whole.advance(1, (i == restart_at) ? 0 : 1);
+                }
+                failed |= split.advance(samples, restart_at) !=
+                    whole.value();
+            }
+        }
+    }
+
+    // A one-shot rises to its peak and stays there.
+    Lfo one_shot;
+    one_shot.set({LfoSettings::Shape::triangle, 10, false, true},
+        sample_rate);
+    const auto peak = one_shot.advance(
+        static_cast<size_t>(sample_rate / 20) + 1);
+    failed |= peak != 1 ||
+        one_shot.advance(static_cast<size_t>(sample_rate)) != 1;
+
+    report("mod", "lfo", "split mismatches", failed);
+    if (failed)
+    {
+        std::fprintf(stderr, "mod: LFO timing depends on the block split\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Publishes from one thread and reads from another as fast as both can
+// for a second, checking that every read is a single complete update and
+// that updates never go back in time. Does the same for the sample clock,
+// starting it just short of where its low half wraps.
+void benchSnapshot()
+{
+    // Roughly the size of EngineParams. Every word holds the generation.
+    struct Payload
+    {
+        std::array<uint32_t, 40> words{};
+    };
+
+    Snapshot<Payload> snapshot;
+    std::atomic<bool> done{false};
+    uint64_t published = 0;
+
+    std::thread writer([&] {
+        Payload payload;
+        uint32_t generation = 0;
+        while (!done.load(std::memory_order_relaxed))
+        {
+            payload.words.fill(++generation);
+            snapshot.publish(payload);
+        }
+        published = generation;
+    });
+
+    uint64_t reads = 0;
+    uint64_t updates = 0;
+    uint64_t torn = 0;
+    uint64_t regressions = 0;
+    uint32_t last = 0;
+    const auto end =
+        std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            const auto& payload = snapshot.read();
+            const auto generation = payload.words[0];
+            const bool whole = std::all_of(
+                payload.words.begin(), payload.words.end(),
+                [&](uint32_t w) { return w == generation; });
+            torn += whole ? 0 : 1;
+            regressions += (generation < last) ? 1 : 0;
+            updates += (generation != last) ? 1 : 0;
+            last = generation;
+            ++reads;
+        }
+    }
+    done = true;
+    writer.join();
+
+    report("snapshot", "stress", "publishes", published);
+    report("snapshot", "stress", "reads", reads);
+    report("snapshot", "stress", "updates_seen", updates);
+    report("snapshot", "stress", "torn_reads", torn);
+    report("snapshot", "stress", "regressions", regressions);
+
+    constexpr size_t calls = 1 << 22;
+    Payload payload;
+    report("snapshot", "publish", "ns/call", nsPerCall([&](size_t n) {
+        for (size_t i = 0; i < n; ++i)
+        {
+            payload.words[0] = static_cast<uint32_t>(i);
+            snapshot.publish(payload);
+        }
+    }, calls));
+    report("snapshot", "read", "ns/call", nsPerCall([&](size_t n) {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            sum += snapshot.read().words[0];
+        }
+        sink = static_cast<float>(sum);
+    }, calls));
+
+    // The audio callback's blocks of 48
+    constexpr uint64_t clock_start = (uint64_t(1) << 32) - (48 << 20);
+    SampleCounter clock;
+    clock.store(clock_start);
+    done = false;
+    std::thread clock_writer([&] {
+        while (!done.load(std::memory_order_relaxed)) { clock.advance(48); }
+    });
+
+    uint64_t clock_reads = 0;
+    uint64_t clock_torn = 0;
+    uint64_t clock_regressions = 0;
+    uint64_t last_time = clock_start;
+    const auto clock_end =
+        std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (std::chrono::steady_clock::now() < clock_end)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            const auto time = clock.load();
+            clock_torn += ((time - clock_start) % 48 != 0) ? 1 : 0;
+            clock_regressions += (time < last_time) ? 1 : 0;
+            last_time = time;
+            ++clock_reads;
+        }
+    }
+    done = true;
+    clock_writer.join();
+
+    report("snapshot", "clock", "reads", clock_reads);
+    report("snapshot", "clock", "wrapped",
+        (clock.written() >> 32) > 0 ? 1 : 0);
+    report("snapshot", "clock", "torn_reads", clock_torn);
+    report("snapshot", "clock", "regressions", clock_regressions);
+    report("snapshot", "clock read", "ns/call", nsPerCall([&](size_t n) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) { sum += clock.load(); }
+        sink = static_cast<float>(sum);
+    }, calls));
+
+    if (torn != 0 || regressions != 0 || clock_torn != 0 ||
+        clock_regressions != 0)
+    {
+        std::fprintf(stderr, "snapshot: inconsistent reads\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Settings slot lookup against simulated flash images in every state the
+// pedal can leave them in. Exits with failure if any lookup is wrong.
+void benchSettings()
+{
+    // About the size of Settings
+    struct Payload
+    {
+        uint32_t sequence;
+        std::array<float, 8> values;
+    };
+    using PayloadSlot = Slot<Payload>;
+    constexpr size_t count = 512;
+
+    bool failed = false;
+    const auto check = [&](const char* name, bool ok) {
+        report("settings", name, "ok", ok ? 1 : 0);
+        failed |= !ok;
+    };
+
+    std::vector<uint8_t> crc_data(4096);
+    for (size_t i = 0; i < crc_data.size(); ++i)
+    {
+        crc_data[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+    }
+    bool crc_ok = true;
+    for (size_t length = 0; length < 64; ++length)
+    {
+        crc_ok &= Crc32c::calculate(crc_data.data() + 3, length) ==
+            Crc32c::reference(crc_data.data() + 3, length);
+    }
+    check("crc matches reference", crc_ok);
+
+    constexpr size_t crc_calls = 1 << 8;
+    report("settings", "crc table", "ns/byte",
+        nsPerCall([&](size_t n) {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                // A new first byte each time, so the call can't be
+                // hoisted out of the loop
+                crc_data[0] = static_cast<uint8_t>(i);
+                sum += Crc32c::calculate(crc_data.data(), crc_data.size());
+            }
+            sink = static_cast<float>(sum);
+        }, crc_calls) / crc_data.size());
+    report("settings", "crc bitwise", "ns/byte",
+        nsPerCall([&](size_t n) {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                // A new first byte each time, so the call can't be
+                // hoisted out of the loop
+                crc_data[0] = static_cast<uint8_t>(i);
+                sum += Crc32c::reference(crc_data.data(), crc_data.size());
+            }
+            sink = static_cast<float>(sum);
+        }, crc_calls) / crc_data.size());
+
+    // The flash image, and saving to it the way the pedal does
+    std::vector<PayloadSlot> image(count);
+    const auto erase = [&] {
+        std::memset(image.data(), 0xFF, image.size() * sizeof(PayloadSlot));
+    };
+    uint32_t sequence = 0;
+    const auto save = [&] {
+        auto frontier = findFrontier(image.data(), count);
+        if (frontier >= count)
+        {
+            erase();
+            frontier = 0;
+        }
+        image[frontier] = PayloadSlot::make({sequence++, {}});
+    };
+    const auto latest = [&]() -> int64_t {
+        const auto* slot = findLatest(
+            image.data(), findFrontier(image.data(), count));
+        return slot ? static_cast<int64_t>(slot->value.sequence) : -1;
+    };
+
+    erase();
+    check("empty", findFrontier(image.data(), count) == 0 && latest() == -1);
+
+    for (int i = 0; i < 100; ++i) { save(); }
+    check("partial", findFrontier(image.data(), count) == 100 &&
+        latest() == 99);
+
+    // A write cut off after the header
+    auto* torn = reinterpret_cast<uint8_t*>(&image[100]);
+    const auto torn_slot = PayloadSlot::make({1000, {}});
+    std::memcpy(torn, &torn_slot, 8);
+    check("torn after header", findFrontier(image.data(), count) == 101 &&
+        latest() == 99);
+
+    // A write cut off inside the header
+    erase();
+    sequence = 0;
+    for (int i = 0; i < 100; ++i) { save(); }
+    std::memcpy(torn, &torn_slot, 2);
+    check("torn inside header", findFrontier(image.data(), count) == 101 &&
+        latest() == 99);
+
+    // Data programmed but not the header
+    erase();
+    sequence = 0;
+    for (int i = 0; i < 100; ++i) { save(); }
+    std::memcpy(torn + 4, reinterpret_cast<const uint8_t*>(&torn_slot) + 4,
+        sizeof(PayloadSlot) - 4);
+    check("torn without header", findFrontier(image.data(), count) == 101 &&
+        latest() == 99);
+    save();
+    check("save after torn", latest() == 100);
+
+    erase();
+    sequence = 0;
+    for (size_t i = 0; i < count; ++i) { save(); }
+    check("full", findFrontier(image.data(), count) == count &&
+        latest() == count - 1);
+
+    // Timing on the full image, against the old backward scan with the
+    // bitwise CRC
+    constexpr size_t load_calls = 1 << 10;
+    report("settings", "load full", "ns/call", nsPerCall([&](size_t n) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) { sum += latest(); }
+        sink = static_cast<float>(sum);
+    }, load_calls));
+    const auto old_load = [&](size_t n) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (auto s = count; s--;)
+            {
+                const auto& slot = image[s];
+                const auto* data = reinterpret_cast<const uint8_t*>(&slot);
+                if (slot.header == PayloadSlot::flag &&
+                    slot.check == Crc32c::reference(
+                        data, sizeof(slot) - sizeof(slot.check)))
+                {
+                    sum += slot.value.sequence;
+                    break;
+                }
+            }
+        }
+        sink = static_cast<float>(sum);
+    };
+    report("settings", "old load full", "ns/call",
+        nsPerCall(old_load, load_calls));
+
+    save();
+    check("wrapped", findFrontier(image.data(), count) == 1 &&
+        latest() == count);
+    for (int i = 0; i < 10; ++i) { save(); }
+    check("wrapped partial", findFrontier(image.data(), count) == 11 &&
+        latest() == count + 10);
+
+    // Every slot damaged
+    for (auto& slot : image) { slot.check ^= 1; }
+    check("all damaged", latest() == -1);
+
+    // The sample rate's preset is kept from settings
+    RamFlash flash;
+    PersistentSettings<RamFlash> store(flash);
+    store.load();
+    store.saveSampleRate(96000);
+    Settings settings;
+    settings.mod_duration = 2000;
+    bool saved = true;
+    for (size_t p = 0; p < user_preset_count; ++p)
+    {
+        saved &= store.savePreset(p, settings);
+        while (!store.idle()) { store.step(); }
+    }
+    check("rate preset kept", saved &&
+        !store.savePreset(user_preset_count, settings) &&
+        !store.loadPreset(user_preset_count, settings) &&
+        store.loadSampleRate(48000) == 96000);
+
+    if (failed)
+    {
+        std::fprintf(stderr, "settings: lookup failed\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Flash in memory, with erase counts per sector. Programming can only clear
+// bits, as on the chip. budget is the number of bytes programmed or sectors
+// erased before a simulated power loss.
+struct MemoryFlash
+{
+    static constexpr size_t sector_size = 4096;
+
+    explicit MemoryFlash(size_t size) :
+        bytes(size, 0xFF), erases(size / sector_size)
+    {}
+
+    size_t size() const { return bytes.size(); }
+    const uint8_t* data() const { return bytes.data(); }
+
+    bool erase(size_t offset, size_t size)
+    {
+        for (auto s = offset / sector_size;
+            s < (offset + size) / sector_size; ++s)
+        {
+            if (budget == 0) { return false; }
+            --budget;
+            std::fill_n(bytes.begin() + s * sector_size, sector_size, 0xFF);
+            ++erases[s];
+        }
+        return true;
+    }
+
+    bool write(size_t offset, const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (budget == 0) { return false; }
+            --budget;
+            bytes[offset + i] &= data[i];
+        }
+        return true;
+    }
+
+    uint32_t maxErases() const
+    {
+        return *std::max_element(erases.begin(), erases.end());
+    }
+
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> erases;
+    size_t budget = std::numeric_limits<size_t>::max();
+};
+
+// The preset bank against the single-preset slots it replaced, saving the
+// same random knob tweaks to both. Checks the bank reloads what was saved,
+// including after power losses at every point of a save and of a
+// compaction. Exits with failure if it doesn't.
+void benchPresets()
+{
+    constexpr size_t bank_size = 32 * 1024;
+    constexpr size_t preset_count = 16;
+    using Bank = PresetBank<MemoryFlash, 64>;
+
+    // The old format: all of Settings in each of 512 slots
+    using OldSlot = Slot<std::array<float, PresetFields::count>>;
+    constexpr size_t old_count = 512;
+
+    bool failed = false;
+    const auto check = [&](const char* name, bool ok) {
+        report("presets", name, "ok", ok ? 1 : 0);
+        failed |= !ok;
+    };
+
+    std::mt19937 random(1);
+    using Presets = std::array<PresetFields, preset_count>;
+    using Saved = std::array<bool, preset_count>;
+    Presets model{};
+    Saved saved{};
+    // Moves one or two knobs of a random preset
+    const auto tweak = [&] {
+        const auto preset = random() % preset_count;
+        const auto knobs = 1 + random() % 2;
+        for (size_t k = 0; k < knobs; ++k)
+        {
+            const auto field = random() % PresetFields::count;
+            const auto max = (1u << PresetFields::bits[field]) - 1;
+            model[preset].values[field] =
+                static_cast<uint16_t>(random() & max);
+        }
+        saved[preset] = true;
+        return preset;
+    };
+    const auto matchesState = [&](const Bank& bank, const Presets& presets,
+        const Saved& present) {
+        for (size_t p = 0; p < preset_count; ++p)
+        {
+            if (bank.has(p) != present[p]) { return false; }
+            if (present[p] && !(bank.get(p) == presets[p])) { return false; }
+        }
+        return true;
+    };
+    const auto matches = [&](const Bank& bank) {
+        return matchesState(bank, model, saved);
+    };
+
+    MemoryFlash flash(bank_size);
+    Bank bank(flash);
+    bank.load();
+    check("empty", matches(bank) && bank.logSize() == 0);
+
+    MemoryFlash old_flash(old_count * sizeof(OldSlot));
+    auto* old_slots = reinterpret_cast<OldSlot*>(old_flash.bytes.data());
+    const auto old_save = [&](size_t preset) {
+        auto frontier = findFrontier(old_slots, old_count);
+        if (frontier >= old_count)
+        {
+            old_flash.erase(0, old_flash.size());
+            frontier = 0;
+        }
+        std::array<float, PresetFields::count> value;
+        std::copy(model[preset].values.begin(), model[preset].values.end(),
+            value.begin());
+        const auto slot = OldSlot::make(value);
+        old_flash.write(frontier * sizeof(OldSlot),
+            reinterpret_cast<const uint8_t*>(&slot), sizeof(slot));
+    };
+
+    constexpr size_t saves = 100000;
+    size_t bank_ok = 0;
+    for (size_t i = 0; i < saves; ++i)
+    {
+        const auto preset = tweak();
+        bank_ok += bank.save(preset, model[preset]);
+        old_save(preset);
+    }
+    check("saves", bank_ok == saves && matches(bank));
+
+    Bank reloaded(flash);
+    reloaded.load();
+    check("reload", matches(reloaded));
+
+    // Saves per erase of the most worn sector
+    report("presets", "bank", "saves/erase",
+        static_cast<double>(saves) / flash.maxErases());
+    report("presets", "old slots", "saves/erase",
+        static_cast<double>(saves) / old_flash.maxErases());
+    report("presets", "full record", "bytes", Bank::recordSize(0xFF));
+    report("presets", "one field", "bytes", Bank::recordSize(0x01));
+    report("presets", "old slot", "bytes", sizeof(OldSlot));
+
+    // Cuts the next save off after every possible number of flash steps,
+    // and checks what loads afterwards is either the old preset or the new.
+    const auto tear = [&](const MemoryFlash& start) {
+        const auto before = model;
+        const auto saved_before = saved;
+        const auto preset = tweak();
+        bool ok = true;
+        bool completed = false;
+        for (size_t budget = 0; !completed; ++budget)
+        {
+            auto torn = start;
+            Bank torn_bank(torn);
+            torn_bank.load();
+            torn.budget = budget;
+            completed = torn_bank.save(preset, model[preset]);
+            torn.budget = std::numeric_limits<size_t>::max();
+
+            Bank after(torn);
+            after.load();
+            const auto old_ok = matchesState(after, before, saved_before);
+            ok &= (!completed && old_ok) || matches(after);
+
+            // Saving again after the loss must work.
+            ok &= after.save(preset, model[preset]);
+            Bank again(torn);
+            again.load();
+            ok &= matches(again);
+        }
+        return ok;
+    };
+
+    check("torn save", tear(flash));
+
+    // Load time as the log fills. It only ever replays one area.
+    constexpr size_t load_calls = 1 << 8;
+    const std::pair<const char*, float> fills[] = {
+        {"load 10%", 0.1f}, {"load 50%", 0.5f}, {"load 100%", 0.99f}};
+    for (const auto& [name, fill] : fills)
+    {
+        MemoryFlash fill_flash(bank_size);
+        Bank fill_bank(fill_flash);
+        fill_bank.load();
+        while (fill_bank.logSize() < fill * fill_bank.areaSize())
+        {
+            const auto preset = tweak();
+            fill_bank.save(preset, model[preset]);
+        }
+        report("presets", name, "ns/call", nsPerCall([&](size_t n) {
+            for (size_t i = 0; i < n; ++i) { fill_bank.load(); }
+            sink = static_cast<float>(fill_bank.logSize());
+        }, load_calls));
+    }
+
+    // A bank one save from compaction
+    MemoryFlash nearly(bank_size);
+    Bank nearly_bank(nearly);
+    nearly_bank.load();
+    for (size_t p = 0; p < preset_count; ++p)
+    {
+        nearly_bank.save(p, model[p]);
+    }
+    while (nearly_bank.logSize() + Bank::recordSize(0x01) <=
+        nearly_bank.areaSize())
+    {
+        const auto preset = tweak();
+        nearly_bank.save(preset, model[preset]);
+    }
+    check("torn compaction", tear(nearly));
+
+    if (failed)
+    {
+        std::fprintf(stderr, "presets: bank check failed\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Simulated time for the control loop, in microseconds. It only moves when
+// a task spends time, or the loop sleeps until the next one is due.
+struct SimulatedClock
+{
+    static uint32_t now() { return ticks; }
+    static uint32_t frequency() { return 1000000; }
+    static void idle() {}
+
+    static inline uint32_t ticks = 0;
+};
+
+// MemoryFlash that takes as long as the QSPI chip: typical datasheet
+// figures for a 4 KB sector erase and a 256-byte page program.
+struct TimedFlash : MemoryFlash
+{
+    static constexpr uint32_t erase_us = 45000;
+    static constexpr uint32_t page_us = 200;
+    static constexpr size_t page_size = 256;
+
+    using MemoryFlash::MemoryFlash;
+
+    bool erase(size_t offset, size_t size)
+    {
+        SimulatedClock::ticks += erase_us * (size / sector_size);
+        return MemoryFlash::erase(offset, size);
+    }
+
+    bool write(size_t offset, const uint8_t* data, size_t size)
+    {
+        const auto pages = (offset + size - 1) / page_size -
+            offset / page_size + 1;
+        SimulatedClock::ticks += page_us * pages;
+        return MemoryFlash::write(offset, data, size);
+    }
+};
+
+// RamFlash that fails every call from the fail_from'th for as many tries
+// as a FlashQueue makes, so one piece of queued work is dropped.
+struct FailingFlash : RamFlash
+{
+    size_t calls = 0;
+    size_t fail_from = std::numeric_limits<size_t>::max();
+
+    bool failing()
+    {
+        const auto call = calls++;
+        return call >= fail_from &&
+            call - fail_from < FlashQueue<RamFlash>::max_attempts;
+    }
+
+    bool erase(size_t offset, size_t size)
+    {
+        return !failing() && RamFlash::erase(offset, size);
+    }
+
+    bool write(size_t offset, const uint8_t* data, size_t size)
+    {
+        return !failing() && RamFlash::write(offset, data, size);
+    }
+};
+
+// Saves through PersistentSettings, with the queue stepped between them,
+// from a bank one save short of compaction, and drops the queued work at
+// each step of the run in turn. Once the pedal carries on saving and the
+// queue drains, the flash must reload as the bank last reported after a
+// reboot. Returns false if it doesn't for any step.
+bool checkDroppedWork()
+{
+    constexpr size_t presets = 16;
+    constexpr size_t saves = 24;
+    using Store = PersistentSettings<FailingFlash>;
+
+    std::mt19937 random(3);
+    const auto randomSettings = [&] {
+        Settings s;
+        std::array<float, EffectState::ratio_count> ratios;
+        for (auto& r : ratios)
+        {
+            r = static_cast<float>(random() % 4096) / 4095.0f;
+        }
+        s.preset.setRatios(ratios);
+        s.mod_duration = random() % 4000;
+        return s;
+    };
+    const auto same = [](const Settings& a, const Settings& b) {
+        return a.preset.ratios() == b.preset.ratios() &&
+            a.mod_duration == b.mod_duration;
+    };
+    const auto drain = [](Store& store) {
+        for (size_t i = 0; i < 10000 && store.step(); ++i) {}
+        return store.idle();
+    };
+
+    // One save short of compaction
+    FailingFlash start;
+    {
+        Store store(start);
+        store.load();
+        const auto record = PresetBank<RamFlash>::recordSize(0xFF);
+        const auto area = settings_bank_size / 2;
+        for (size_t used = 16; used + 2 * record <= area; used += record)
+        {
+            store.savePreset(random() % presets, randomSettings());
+            drain(store);
+        }
+    }
+    std::vector<std::pair<size_t, Settings>> run(saves);
+    for (auto& [preset, settings] : run)
+    {
+        preset = random() % presets;
+        settings = randomSettings();
+    }
+
+    // Returns false if the reboot doesn't match. Sets calls to the flash
+    // calls the run made.
+    const auto attempt = [&](size_t fail_from, size_t& calls) {
+        auto flash = start;
+        flash.calls = 0;
+        flash.fail_from = fail_from;
+        Store store(flash);
+        store.load();
+        std::array<std::optional<Settings>, presets> saved;
+        for (const auto& [preset, settings] : run)
+        {
+            // A rejected save is tried again by the pedal later.
+            while (!store.savePreset(preset, settings)) { store.step(); }
+            saved[preset] = settings;
+            store.step();
+            store.step();
+        }
+        const bool drained = drain(store);
+        calls = flash.calls;
+
+        RamFlash image = flash;
+        PersistentSettings<RamFlash> rebooted(image);
+        rebooted.load();
+        bool ok = drained;
+        for (size_t p = 0; p < presets; ++p)
+        {
+            Settings reported;
+            Settings reloaded;
+            const bool had = store.loadPreset(p, reported);
+            ok &= rebooted.loadPreset(p, reloaded) == had;
+            ok &= !had || same(reported, reloaded);
+            ok &= !saved[p] || (had && same(reloaded, *saved[p]));
+        }
+        return ok;
+    };
+
+    size_t calls = 0;
+    bool ok = attempt(std::numeric_limits<size_t>::max(), calls);
+    const auto total = calls;
+    for (size_t fail_from = 0; fail_from < total; ++fail_from)
+    {
+        ok &= attempt(fail_from, calls);
+    }
+    return ok;
+}
+
+// How late the 1 kHz switch task starts while the storage task saves a
+// knob change ten times a second, for ten simulated minutes. Compares the
+// old slots, the preset bank erasing and writing inline, and the bank
+// going through a FlashQueue stepped by its own task. Exits with failure
+// if the queued bank doesn't reload what was saved.
+void benchFlash()
+{
+    constexpr uint32_t duration_us = 600 * 1000000u;
+    constexpr size_t preset_count = 16;
+
+    std::mt19937 random(2);
+    std::array<PresetFields, preset_count> model{};
+    const auto tweak = [&] {
+        const auto preset = random() % preset_count;
+        const auto field = random() % PresetFields::count;
+        model[preset].values[field] = static_cast<uint16_t>(random() & 0xFFF);
+        return preset;
+    };
+
+    // Runs the switch and storage tasks, plus flash_step at 100 Hz, and
+    // reports the timing.
+    const auto simulate = [&](const char* name, auto&& save,
+        auto&& flash_step) {
+        SimulatedClock::ticks = 0;
+        auto tasks = makeScheduler<SimulatedClock>(
+            Task{"switches", 1000, [] {}},
+            Task{"storage", 10, [&] { save(tweak()); }},
+            Task{"flash", 100, [&] { flash_step(); }});
+        while (SimulatedClock::ticks < duration_us)
+        {
+            const auto next = tasks.poll();
+            if (static_cast<int32_t>(next - SimulatedClock::ticks) > 0)
+            {
+                SimulatedClock::ticks = next;
+            }
+        }
+        const auto& late = tasks.lateness(0);
+        report("flash", name, "switch late max us", late.max());
+        report("flash", name, "switch late p99 us", late.percentile(0.99f));
+        report("flash", name, "storage run max us", tasks.runTime(1).max());
+        report("flash", name, "flash run max us", tasks.runTime(2).max());
+    };
+
+    // The old format: every save writes a slot, and a full ring erases all
+    // five sectors at once.
+    using OldSlot = Slot<std::array<float, PresetFields::count>>;
+    constexpr size_t old_count = 512;
+    TimedFlash old_flash(old_count * sizeof(OldSlot));
+    auto* old_slots = reinterpret_cast<OldSlot*>(old_flash.bytes.data());
+    simulate("old slots", [&](size_t preset) {
+        auto frontier = findFrontier(old_slots, old_count);
+        if (frontier >= old_count)
+        {
+            old_flash.erase(0, old_flash.size());
+            frontier = 0;
+        }
+        std::array<float, PresetFields::count> value;
+        std::copy(model[preset].values.begin(), model[preset].values.end(),
+            value.begin());
+        const auto slot = OldSlot::make(value);
+        old_flash.write(frontier * sizeof(OldSlot),
+            reinterpret_cast<const uint8_t*>(&slot), sizeof(slot));
+    }, [] {});
+
+    constexpr size_t bank_size = 32 * 1024;
+    TimedFlash direct_flash(bank_size);
+    PresetBank<TimedFlash> direct(direct_flash);
+    direct.load();
+    simulate("bank inline", [&](size_t preset) {
+        direct.save(preset, model[preset]);
+    }, [] {});
+
+    TimedFlash queued_flash(bank_size);
+    FlashQueue<TimedFlash> queue(queued_flash);
+    PresetBank<decltype(queue)> queued(queue);
+    queued.load();
+    size_t rejected = 0;
+    simulate("bank queued", [&](size_t preset) {
+        rejected += !queued.save(preset, model[preset]);
+    }, [&] {
+        if (!queue.idle()) { queue.step(); }
+        else { queued.maintain(); }
+    });
+    while (!queue.idle()) { queue.step(); }
+
+    report("flash", "bank queued", "saves rejected", rejected);
+    PresetBank<TimedFlash> reloaded(queued_flash);
+    reloaded.load();
+    bool ok = rejected == 0 && queue.errors() == 0;
+    for (size_t p = 0; p < preset_count; ++p)
+    {
+        ok &= reloaded.has(p) && reloaded.get(p) == model[p];
+    }
+    report("flash", "bank queued", "reload ok", ok ? 1 : 0);
+
+    const auto dropped_ok = checkDroppedWork();
+    report("flash", "dropped work", "reload ok", dropped_ok ? 1 : 0);
+
+    if (!ok || !dropped_ok)
+    {
+        std::fprintf(stderr, "flash: queued saves lost\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Stands in for the USB port: writes to a pipe, and turns away every
+// seventh batch as if the host were slow to take it.
+struct PipePort
+{
+    int fd;
+    size_t calls = 0;
+    size_t busy = 0;
+
+    bool write(const uint8_t* data, size_t size)
+    {
+        if (++calls % 7 == 0)
+        {
+            busy++;
+            return false;
+        }
+        return writeAll(data, size);
+    }
+
+    bool writeAll(const uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const auto written = ::write(fd, data, size);
+            if (written <= 0) { return false; }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+};
+
+// The cost of recording a block, and the whole path from the engine to
+// decoded records. The engine runs over plucked notes on one thread,
+// recording every block; another drains the ring through a pipe, with log
+// text mixed in, and the main thread decodes what comes out. A second
+// recorder with room for everything keeps what should have been sent.
+// Exits with failure if a decoded record differs from it, or the records
+// decoded and dropped don't add up.
+void benchTelemetry()
+{
+    constexpr size_t block_size = 48;
+    constexpr size_t decimation = 2;
+
+    TelemetryRecord block{.frequency = 220, .envelope = 0.5f,
+        .cycles = 1000, .flags = TelemetryRecord::gate_open};
+    for (const size_t d : {size_t(1), decimation})
+    {
+        TelemetryRecorder<256> recorder(d);
+        std::array<TelemetryRecord, 128> drained;
+        char name[32];
+        std::snprintf(name, sizeof(name), "record /%zu", d);
+        // Drained every 128 blocks, so it isn't all drops
+        report("telemetry", name, "ns/call", nsPerCall([&](size_t n) {
+            for (size_t i = 0; i < n; ++i)
+            {
+                block.time = static_cast<uint32_t>(i);
+                recorder.record(block);
+                if (i % 128 == 127)
+                {
+                    recorder.ring().pop(drained.data(), drained.size());
+                }
+            }
+        }, 1 << 22));
+    }
+
+    // A full ring drops, and takes records again once drained.
+    TelemetryRing<4> small;
+    size_t accepted = 0;
+    for (uint32_t i = 0; i < 10; ++i) { accepted += small.push({.time = i}); }
+    std::array<TelemetryRecord, 8> out;
+    const auto popped = small.pop(out.data(), out.size());
+    accepted += small.push({.time = 10});
+    const bool small_ok = accepted == 5 && small.dropped() == 6 &&
+        popped == 4 && out[0].time == 0 && out[3].time == 3;
+    report("telemetry", "small ring", "dropped", small.dropped());
+
+    constexpr size_t length = 4 * static_cast<size_t>(sample_rate);
+    const auto input = pluckedNotes(length);
+    const auto params = synthParams();
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        std::fprintf(stderr, "telemetry: can't open a pipe\n");
+        std::exit(EXIT_FAILURE);
+    }
+
+    TelemetryRecorder<256> recorder(decimation);
+    TelemetryRecorder<4096> expected(decimation);
+    std::atomic<bool> produced{false};
+    std::thread producer([&] {
+        SynthEngine engine(sample_rate);
+        std::vector<float> output(block_size);
+        for (size_t i = 0; i + block_size <= length; i += block_size)
+        {
+            const auto begin = CycleCounter::now();
+            engine.process(input.data() + i, output.data(), block_size,
+                params, i);
+            const auto& status = engine.status();
+            const TelemetryRecord record{
+                .time = static_cast<uint32_t>(i),
+                .frequency = status.frequency,
+                .envelope = status.envelope,
+                .mod_ratio = status.mod_ratio,
+                .cycles = CycleCounter::now() - begin,
+                .flags = static_cast<uint8_t>(
+                    (status.note_shift ? TelemetryRecord::note_shift : 0) |
+                    (status.gate_open ? TelemetryRecord::gate_open : 0) |
+                    (status.gate_opened ? TelemetryRecord::gate_opened : 0)),
+            };
+            recorder.record(record);
+            expected.record(record);
+        }
+        produced = true;
+    });
+
+    PipePort port{fds[1]};
+    size_t sent = 0;
+    std::thread consumer([&] {
+        TelemetrySender<16> sender;
+        constexpr std::string_view log = "Telemetry records dropped 0\n";
+        for (size_t step = 0;; ++step)
+        {
+            // Read before stepping, so nothing pushed after is left behind
+            const bool last = produced.load();
+            const auto count = sender.step(recorder.ring(), port);
+            sent += count;
+            if (step % 50 == 0)
+            {
+                port.writeAll(reinterpret_cast<const uint8_t*>(log.data()),
+                    log.size());
+            }
+            if (last && count == 0 && sender.idle()) { break; }
+            if (count == 0) { std::this_thread::yield(); }
+        }
+        close(fds[1]);
+    });
+
+    TelemetryParser parser;
+    std::vector<TelemetryRecord> decoded;
+    std::array<uint8_t, 4096> buffer;
+    ssize_t count;
+    while ((count = read(fds[0], buffer.data(), buffer.size())) > 0)
+    {
+        parser.feed(buffer.data(), static_cast<size_t>(count),
+            [&](const TelemetryRecord& r) { decoded.push_back(r); });
+    }
+    close(fds[0]);
+    producer.join();
+    consumer.join();
+
+    std::vector<TelemetryRecord> reference(length / block_size);
+    reference.resize(
+        expected.ring().pop(reference.data(), reference.size()));
+
+    // Envelope and mod ratio travel as 16 bits.
+    const auto same = [](const TelemetryRecord& a, const TelemetryRecord& b) {
+        constexpr float step = 1.0f / 65535;
+        return a.time == b.time && a.frequency == b.frequency &&
+            std::abs(a.envelope - std::min(b.envelope, 1.0f)) <= step &&
+            std::abs(a.mod_ratio - b.mod_ratio) <= step &&
+            a.cycles == b.cycles && a.flags == b.flags &&
+            a.blocks == b.blocks;
+    };
+    size_t mismatched = 0;
+    size_t events = 0;
+    uint16_t last_dropped = 0;
+    auto next = reference.begin();
+    for (const auto& r : decoded)
+    {
+        next = std::find_if(next, reference.end(),
+            [&](const TelemetryRecord& e) { return e.time == r.time; });
+        if (next == reference.end() || !same(r, *next) ||
+            r.dropped < last_dropped)
+        {
+            mismatched++;
+            next = reference.begin();
+            continue;
+        }
+        last_dropped = r.dropped;
+        events += (r.flags & (TelemetryRecord::note_shift |
+            TelemetryRecord::gate_opened)) ? 1 : 0;
+    }
+
+    const auto dropped = recorder.ring().dropped();
+    report("telemetry", "pipe", "records", reference.size());
+    report("telemetry", "pipe", "decoded", decoded.size());
+    report("telemetry", "pipe", "dropped", dropped);
+    report("telemetry", "pipe", "busy", port.busy);
+    report("telemetry", "pipe", "onsets and shifts", events);
+    report("telemetry", "pipe", "bytes skipped", parser.skipped());
+    report("telemetry", "pipe", "bad frames", parser.bad());
+    report("telemetry", "pipe", "mismatched", mismatched);
+
+    if (!small_ok || mismatched != 0 || parser.bad() != 0 ||
+        decoded.size() != sent ||
+        decoded.size() + dropped != reference.size() || events == 0)
+    {
+        std::fprintf(stderr, "telemetry: records lost or changed\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Prints the change from old to new of every timing in both runs, as a
+// percentage of the old one, and lists those more than 10% slower.
+// Returns false if either run can't be read.
+bool compareRuns(const char* old_path, const char* new_path)
+{
+    const auto load = [](const char* path, auto& values) {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            const auto tab = line.rfind('\t');
+            if (tab == std::string::npos) { continue; }
+            values.emplace_back(line.substr(0, tab),
+                std::strtod(line.c_str() + tab + 1, nullptr));
+        }
+        return static_cast<bool>(file.eof());
+    };
+
+    std::vector<std::pair<std::string, double>> old_run;
+    std::vector<std::pair<std::string, double>> new_run;
+    if (!load(old_path, old_run) || !load(new_path, new_run))
+    {
+        std::fprintf(stderr, "compare: can't read %s or %s\n",
+            old_path, new_path);
+        return false;
+    }
+
+    const std::map<std::string, double> old_values(
+        old_run.begin(), old_run.end());
+    for (const auto& [key, value] : new_run)
+    {
+        const auto old = old_values.find(key);
+        if (key.find("ns/") == std::string::npos ||
+            old == old_values.end() || old->second <= 0)
+        {
+            continue;
+        }
+        const auto change = 100 * (value - old->second) / old->second;
+        std::printf("%s change %%\t%.4g\n", key.c_str(), change);
+        if (change > 10)
+        {
+            std::fprintf(stderr, "slower: %s, %.4g -> %.4g\n", key.c_str(),
+                old->second, value);
+        }
+    }
+    return true;
+}
+
+struct Suite
+{
+    std::string_view name;
+    std::function<void()> run;
+};
+
+const Suite suites[] = {
+    {"wave", benchWave},
+    {"filter", benchFilter},
+    {"units", benchUnits},
+    {"mapping", benchMapping},
+    {"golden", benchGolden},
+    {"voices", benchVoices},
+    {"blocks", benchBlocks},
+    {"oversampling", benchOversampling},
+    {"rates", benchRates},
+    {"mod", benchMod},
+    {"snapshot", benchSnapshot},
+    {"settings", benchSettings},
+    {"presets", benchPresets},
+    {"flash", benchFlash},
+    {"telemetry", benchTelemetry},
+};
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        for (const auto& suite : suites) { suite.run(); }
+        return EXIT_SUCCESS;
+    }
+
+    const std::string_view option = argv[1];
+    if (option == "--update-golden")
+    {
+        update_golden = true;
+        benchGolden();
+        return EXIT_SUCCESS;
+    }
+    if (option == "--compare")
+    {
+        if (argc != 4)
+        {
+            std::fprintf(stderr, "usage: terrarium-bench --compare OLD NEW\n");
+            return EXIT_FAILURE;
+        }
+        return compareRuns(argv[2], argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto match = std::find_if(
+            std::begin(suites), std::end(suites),
+            [&](const Suite& s) { return s.name == argv[i]; });
+        if (match == std::end(suites))
+        {
+            std::fprintf(stderr, "unknown suite: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        match->run();
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+// Offline renderer: streams a WAV file through SynthEngine block by block.
+//
+// Usage: terrarium-render [options] input.wav output.wav
+//
+// Knob settings are ratios in [0, 1]. Options prefixed with --preset- set
+// the saved preset instead of the current controls.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/SynthEngine.h>
+
+#include "WavFile.h"
+
+namespace
+{
+
+void usage()
+{
+    std::fputs(
+        "usage: terrarium-render [options] input.wav output.wav\n"
+        "\n"
+        "  --block N          samples per block (default 48)\n"
+        "  --channel N        input channel to process (default 0)\n"
+        "  --bypass           pass the dry signal through\n"
+        "  --dry R            dry level knob\n"
+        "  --synth R          synth level knob\n"
+        "  --trigger R        trigger threshold knob\n"
+        "  --wave R           wave shape knob\n"
+        "  --filter R         filter knob\n"
+        "  --res R            resonance knob\n"
+        "  --noise            noise toggle on\n"
+        "  --envelope         envelope toggle on\n"
+        "  --preset-<knob>    as above, for the saved preset\n"
+        "  --use-preset       play the saved preset\n"
+        "  --mod              modulate between preset and knobs\n"
+        "  --cycle            oscillating modulation\n"
+        "  --mod-duration MS  modulation period in milliseconds\n"
+        "  --env-filter D     envelope to filter corner depth\n"
+        "  --filter-stages N  filter slope, 12 dB/octave per stage (1-4)\n"
+        "  --decimate N       analysis rate divider (1, 2 or 4; default 1)\n"
+        "  --oversample N     oscillator and filter rate multiple (1, 2 or 4;\n"
+        "                     default 1)\n"
+        "  --harmony NAME     unison, octaves, fifths, power or stack\n"
+        "  --voice S[,C[,G]]  add a voice S semitones and C cents from the\n"
+        "                     note, at gain G; repeat for more voices\n"
+        "  --lfo1 S,HZ[,F..]  LFO shape (sine, tri, ramp or sh) and rate;\n"
+        "  --lfo2 S,HZ[,F..]  flags once (one-shot) and free (no retrigger)\n"
+        "  --route SRC:DST:A  modulate DST (filter, shape, dry, synth or\n"
+        "                     noise) from SRC (lfo1, lfo2 or envelope) by\n"
+        "                     amount A; repeat for more routes\n",
+        stderr);
+}
+
+// Applies a knob or toggle option to the given state.
+// Returns false if the option isn't a state option.
+bool applyStateOption(
+    EffectState& state, std::string_view name, const char* value)
+{
+    const auto ratio = value ? std::strtof(value, nullptr) : 0.0f;
+    if (name == "dry") { state.setDryRatio(ratio); }
+    else if (name == "synth") { state.setSynthRatio(ratio); }
+    else if (name == "wave") { state.setWaveRatio(ratio); }
+    else if (name == "filter") { state.setFilterRatio(ratio); }
+    else if (name == "res") { state.setResonanceRatio(ratio); }
+    else if (name == "noise") { state.setNoiseEnabled(true); }
+    else if (name == "envelope") { state.setEnvelopeEnabled(true); }
+    else { return false; }
+    return true;
+}
+
+bool parseHarmony(std::string_view name, Harmony& harmony)
+{
+    if (name == "unison") { harmony = Harmony::unison(); }
+    else if (name == "octaves") { harmony = Harmony::octaves(); }
+    else if (name == "fifths") { harmony = Harmony::fifths(); }
+    else if (name == "power") { harmony = Harmony::power(); }
+    else if (name == "stack") { harmony = Harmony::stack(); }
+    else { return false; }
+    return true;
+}
+
+// Parses "semitones[,cents[,gain]]".
+HarmonyVoice parseVoice(const char* value)
+{
+    HarmonyVoice voice;
+    char* end = nullptr;
+    voice.semitones = std::strtof(value, &end);
+    if (*end == ',') { voice.detune_cents = std::strtof(end + 1, &end); }
+    if (*end == ',') { voice.gain = std::strtof(end + 1, &end); }
+    return voice;
+}
+
+// Parses "shape,hz[,once][,free]".
+bool parseLfo(std::string_view value, LfoSettings& lfo)
+{
+    using Shape = LfoSettings::Shape;
+    auto next = [&value]() {
+        const auto comma = value.find(',');
+        const auto field = value.substr(0, comma);
+        value = (comma == std::string_view::npos) ?
+            std::string_view() : value.substr(comma + 1);
+        return field;
+    };
+
+    const auto shape = next();
+    if (shape == "sine") { lfo.shape = Shape::sine; }
+    else if (shape == "tri") { lfo.shape = Shape::triangle; }
+    else if (shape == "ramp") { lfo.shape = Shape::ramp; }
+    else if (shape == "sh") { lfo.shape = Shape::sample_hold; }
+    else { return false; }
+
+    lfo.frequency = std::strtof(std::string(next()).c_str(), nullptr);
+    while (!value.empty())
+    {
+        const auto flag = next();
+        if (flag == "once") { lfo.cycle = false; }
+        else if (flag == "free") { lfo.retrigger = false; }
+        else { return false; }
+    }
+    return lfo.frequency > 0;
+}
+
+// Parses "source:destination:amount".
+bool parseRoute(std::string_view value, ModRoute& route)
+{
+    const auto first = value.find(':');
+    const auto second = value.find(':', first + 1);
+    if (second == std::string_view::npos) { return false; }
+    const auto source = value.substr(0, first);
+    const auto destination = value.substr(first + 1, second - first - 1);
+
+    if (source == "lfo1") { route.source = ModSource::lfo1; }
+    else if (source == "lfo2") { route.source = ModSource::lfo2; }
+    else if (source == "envelope") { route.source = ModSource::envelope; }
+    else { return false; }
+
+    using Destination = ModDestination;
+    if (destination == "filter") { route.destination = Destination::filter; }
+    else if (destination == "shape") { route.destination = Destination::shape; }
+    else if (destination == "dry") { route.destination = Destination::dry_level; }
+    else if (destination == "synth") { route.destination = Destination::synth_level; }
+    else if (destination == "noise") { route.destination = Destination::noise_rate; }
+    else { return false; }
+
+    route.amount = std::strtof(
+        std::string(value.substr(second + 1)).c_str(), nullptr);
+    return true;
+}
+
+bool takesValue(std::string_view name)
+{
+    return name != "noise" && name != "envelope";
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    EngineParams params;
+    params.enable_effect = true;
+    size_t block_size = 48;
+    size_t decimation = 1;
+    bool custom_voices = false;
+    uint16_t channel = 0;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg.substr(0, 2) != "--")
+        {
+            paths.emplace_back(arg);
+            continue;
+        }
+
+        auto name = arg.substr(2);
+        auto* state = &params.interface_state;
+        if (name.substr(0, 7) == "preset-")
+        {
+            state = &params.preset_state;
+            name = name.substr(7);
+        }
+
+        const bool flag = (name == "bypass" || name == "use-preset" ||
+            name == "mod" || name == "cycle" || !takesValue(name));
+        const char* value = nullptr;
+        if (!flag)
+        {
+            if (i + 1 >= argc)
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+            value = argv[++i];
+        }
+
+        if (applyStateOption(*state, name, value)) { continue; }
+        if (state != &params.interface_state)
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+
+        if (name == "block") { block_size = std::strtoul(value, nullptr, 10); }
+        else if (name == "decimate") { decimation = std::strtoul(value, nullptr, 10); }
+        else if (name == "channel") { channel = std::atoi(value); }
+        else if (name == "bypass") { params.enable_effect = false; }
+        else if (name == "trigger") { params.trigger_ratio = std::strtof(value, nullptr); }
+        else if (name == "use-preset") { params.use_preset = true; }
+        else if (name == "mod") { params.apply_mod = true; }
+        else if (name == "cycle") { params.cycle_mod = true; }
+        else if (name == "mod-duration") { params.mod_duration = std::strtof(value, nullptr); }
+        else if (name == "filter-stages") { params.filter_stages = std::strtoul(value, nullptr, 10); }
+        else if (name == "oversample") { params.oversampling = std::strtoul(value, nullptr, 10); }
+        else if (name == "harmony")
+        {
+            if (!parseHarmony(value, params.harmony))
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (name == "voice")
+        {
+            // --voice options replace the whole harmony.
+            if (!custom_voices) { params.harmony.count = 0; }
+            custom_voices = true;
+            if (!params.harmony.add(parseVoice(value)))
+            {
+                std::fprintf(stderr, "at most %zu voices\n",
+                    Harmony::max_voices);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (name == "lfo1" || name == "lfo2")
+        {
+            auto& lfo = params.mod.lfos[(name == "lfo1") ? 0 : 1];
+            if (!parseLfo(value, lfo))
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (name == "route")
+        {
+            ModRoute route;
+            if (!parseRoute(value, route))
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+            if (!params.mod.add(route))
+            {
+                std::fprintf(stderr, "at most %zu routes\n",
+                    ModSettings::max_routes);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (name == "env-filter") { params.envelope_filter_depth = std::strtof(value, nullptr); }
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (paths.size() != 2 || block_size == 0 || params.mod_duration <= 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    WavReader reader(paths[0]);
+    if (!reader.isOpen() || channel >= reader.channels())
+    {
+        std::fprintf(stderr, "can't read %s\n", paths[0].c_str());
+        return EXIT_FAILURE;
+    }
+
+    WavWriter writer(paths[1], reader.sampleRate());
+    if (!writer.isOpen())
+    {
+        std::fprintf(stderr, "can't write %s\n", paths[1].c_str());
+        return EXIT_FAILURE;
+    }
+
+    const auto sample_rate = static_cast<float>(reader.sampleRate());
+    SynthEngine engine(sample_rate, decimation);
+    std::vector<float> in(block_size);
+    std::vector<float> out(block_size);
+
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t frames = 0;
+    size_t count = 0;
+    while ((count = reader.read(in.data(), block_size, channel)) > 0)
+    {
+        engine.process(in.data(), out.data(), count, params, frames);
+        writer.write(out.data(), count);
+        frames += count;
+    }
+    const auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const auto audio_seconds = frames / sample_rate;
+    std::fprintf(stderr,
+        "rendered %.2f s of audio in %.3f s (%.0fx real time)\n",
+        audio_seconds, elapsed, elapsed > 0 ? audio_seconds / elapsed : 0.0);
+    std::fprintf(stderr, "%.0f parameter recomputes per second of audio\n",
+        engine.effectCache().recomputeCount() / audio_seconds);
+
+    if constexpr (profiling_enabled)
+    {
+        std::fprintf(stderr, "nanoseconds per block:\n");
+        engine.profiler().dump(
+            [](auto... args) {
+                std::fprintf(stderr, args...);
+                std::fputc('\n', stderr);
+            },
+            SynthEngine::stage_names);
+        std::fprintf(stderr,
+            "voice cost %.1f ns/sample, room for %zu voices at %.0f Hz\n",
+            engine.voiceCost(), engine.voiceCapacity(), sample_rate);
+    }
+    return EXIT_SUCCESS;
+}
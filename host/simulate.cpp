@@ -0,0 +1,390 @@
+// Runs the pedal's control loop and audio callback together on simulated
+// time, as fast as the CPU allows.
+//
+// Usage: terrarium-sim [options] script.txt
+//
+// The script moves the controls. Each line gives a time in seconds, a
+// control and a value:
+//
+//   0.5   filter  0.3    knobs: dry, synth, trigger, wave, filter, res
+//   1     mod     on     toggles: noise, env, mod, cycle (on or off)
+//   2     preset  down   foot switches: bypass, preset (down or up)
+//   30    loop           start the script over
+//
+// Controls set at time 0 are in place at power-up, so holding both foot
+// switches there chooses the sample rate as on the pedal.
+//
+// Blank lines and lines starting with # are skipped. At the end it prints
+// a summary, waits for the settings to finish saving, and checks that they
+// reload from the simulated flash as the pedal last saved them and that
+// the audio stayed finite. Exits with failure if not.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <numbers>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/Pedal.h>
+
+#include "SimTerrarium.h"
+#include "WavFile.h"
+
+namespace
+{
+
+using Control = SimTerrarium::Control;
+
+struct ControlName
+{
+    std::string_view name;
+    Control control;
+    int index;
+};
+
+constexpr ControlName control_names[] = {
+    {"dry", Control::knob, 0},
+    {"synth", Control::knob, 1},
+    {"trigger", Control::knob, 2},
+    {"wave", Control::knob, 3},
+    {"filter", Control::knob, 4},
+    {"res", Control::knob, 5},
+    {"noise", Control::toggle, 0},
+    {"env", Control::toggle, 1},
+    {"mod", Control::toggle, 2},
+    {"cycle", Control::toggle, 3},
+    {"bypass", Control::stomp, 0},
+    {"preset", Control::stomp, 1},
+};
+
+void usage()
+{
+    std::fputs(
+        "usage: terrarium-sim [options] script.txt\n"
+        "\n"
+        "  --seconds S        simulated time to run (default 60)\n"
+        "  --input FILE       WAV file to play on repeat (default plucked\n"
+        "                     notes)\n"
+        "  --output FILE      write the audio to a WAV file\n"
+        "  --flash FILE       settings flash image, loaded if it exists and\n"
+        "                     saved at the end\n"
+        "  --telemetry FILE   write the USB telemetry stream to a file\n"
+        "  --quiet            drop the pedal's log output\n",
+        stderr);
+}
+
+// Returns false, after printing why, if the script doesn't make sense.
+bool readScript(const std::string& path,
+    std::vector<SimTerrarium::Event>& events)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::fprintf(stderr, "can't read %s\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    size_t number = 0;
+    double last = 0;
+    bool looped = false;
+    while (std::getline(file, line))
+    {
+        ++number;
+        std::istringstream fields(line);
+        double seconds;
+        std::string name;
+        std::string value;
+        if (line.empty() || line[0] == '#') { continue; }
+        const auto fail = [&](const char* why) {
+            std::fprintf(stderr, "%s:%zu: %s\n", path.c_str(), number, why);
+            return false;
+        };
+        if (!(fields >> seconds >> name)) { return fail("expected a time"); }
+        if (looped) { return fail("nothing can follow loop"); }
+        if (seconds < last) { return fail("times must not go back"); }
+        last = seconds;
+
+        SimTerrarium::Event event{
+            static_cast<uint64_t>(std::llround(seconds * 1e6)),
+            Control::loop, 0, 0};
+        if (name == "loop")
+        {
+            if (event.time == 0) { return fail("loop needs a time"); }
+            looped = true;
+            events.push_back(event);
+            continue;
+        }
+
+        const auto* control = std::find_if(std::begin(control_names),
+            std::end(control_names),
+            [&](const ControlName& c) { return c.name == name; });
+        if (control == std::end(control_names) || !(fields >> value))
+        {
+            return fail("expected a control and a value");
+        }
+        event.control = control->control;
+        event.index = control->index;
+
+        switch (event.control)
+        {
+        case Control::knob:
+            event.value = std::strtof(value.c_str(), nullptr);
+            if (event.value < 0 || event.value > 1)
+            {
+                return fail("knobs go from 0 to 1");
+            }
+            break;
+        case Control::toggle:
+            if (value != "on" && value != "off")
+            {
+                return fail("toggles are on or off");
+            }
+            event.value = (value == "on") ? 1 : 0;
+            break;
+        case Control::stomp:
+            if (value != "down" && value != "up")
+            {
+                return fail("foot switches are down or up");
+            }
+            event.value = (value == "down") ? 1 : 0;
+            break;
+        case Control::loop:
+            break;
+        }
+        events.push_back(event);
+    }
+    return true;
+}
+
+// A note every half second, decaying, walking up an octave and back
+std::vector<float> pluckedNotes(float sample_rate)
+{
+    constexpr size_t note_count = 24;
+    const auto note_length = static_cast<size_t>(sample_rate / 2);
+    std::vector<float> notes(note_count * note_length);
+    for (size_t i = 0; i < notes.size(); ++i)
+    {
+        const auto note = i / note_length;
+        const auto step = (note < 12) ? note : 24 - note;
+        const auto t = static_cast<float>(i % note_length) / sample_rate;
+        const auto frequency = 110 * std::exp2(step / 12.0f);
+        notes[i] = 0.5f * std::exp(-5 * t) *
+            std::sin(2 * std::numbers::pi_v<float> * frequency * t);
+    }
+    return notes;
+}
+
+std::optional<Pedal<SimTerrarium>> pedal;
+
+void processAudioBlock(const float* const* in, float** out, size_t size)
+{
+    pedal->processAudio(in[0], out[0], size);
+    std::fill_n(out[1], size, 0.0f);
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    double seconds = 60;
+    std::string input_path;
+    std::string output_path;
+    std::string flash_path;
+    std::string telemetry_path;
+    bool quiet = false;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg.substr(0, 2) != "--")
+        {
+            paths.emplace_back(arg);
+            continue;
+        }
+
+        const auto name = arg.substr(2);
+        if (name == "quiet")
+        {
+            quiet = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+        const char* value = argv[++i];
+        if (name == "seconds") { seconds = std::strtod(value, nullptr); }
+        else if (name == "input") { input_path = value; }
+        else if (name == "output") { output_path = value; }
+        else if (name == "flash") { flash_path = value; }
+        else if (name == "telemetry") { telemetry_path = value; }
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<SimTerrarium::Event> events;
+    if (paths.size() != 1 || seconds <= 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (!readScript(paths[0], events)) { return EXIT_FAILURE; }
+
+    float sample_rate = 48000;
+    std::vector<float> input;
+    if (!input_path.empty())
+    {
+        WavReader reader(input_path);
+        if (!reader.isOpen())
+        {
+            std::fprintf(stderr, "can't read %s\n", input_path.c_str());
+            return EXIT_FAILURE;
+        }
+        sample_rate = static_cast<float>(reader.sampleRate());
+        input.resize(reader.frames());
+        input.resize(reader.read(input.data(), input.size()));
+    }
+    else
+    {
+        input = pluckedNotes(sample_rate);
+    }
+
+    std::FILE* telemetry = nullptr;
+    if (!telemetry_path.empty())
+    {
+        telemetry = std::fopen(telemetry_path.c_str(), "wb");
+        if (!telemetry)
+        {
+            std::fprintf(stderr, "can't write %s\n", telemetry_path.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Opened once the pedal has chosen its sample rate
+    std::optional<WavWriter> writer;
+    SimTerrarium hardware(sample_rate, audio_block_size, std::move(input));
+    hardware.log = quiet ? nullptr : stdout;
+    hardware.usb = telemetry;
+    uint64_t nonfinite = 0;
+    hardware.on_output = [&](const float* out, size_t size) {
+        nonfinite += std::count_if(out, out + size,
+            [](float x) { return !std::isfinite(x); });
+        if (writer) { writer->write(out, size); }
+    };
+    if (!flash_path.empty() && hardware.flash().load(flash_path))
+    {
+        std::fprintf(stderr, "loaded settings flash from %s\n",
+            flash_path.c_str());
+    }
+    hardware.setScript(std::move(events));
+    SimClock::hardware = &hardware;
+
+    const auto start = std::chrono::steady_clock::now();
+    pedal.emplace(hardware);
+
+    // The pedal may have chosen another rate at power-up.
+    if (hardware.SampleRate() != sample_rate)
+    {
+        sample_rate = hardware.SampleRate();
+        if (input_path.empty())
+        {
+            hardware.setInput(pluckedNotes(sample_rate));
+        }
+    }
+    if (!output_path.empty())
+    {
+        writer.emplace(output_path, static_cast<uint32_t>(sample_rate));
+        if (!writer->isOpen())
+        {
+            std::fprintf(stderr, "can't write %s\n", output_path.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto tasks = pedal->tasks();
+    pedal->start(processAudioBlock);
+
+    // Scheduler::run, for a while
+    const auto runUntil = [&](uint64_t end_us, auto&& done) {
+        while (hardware.micros() < end_us && !done())
+        {
+            const auto next = tasks.poll();
+            while (static_cast<int32_t>(next - SimClock::now()) > 0)
+            {
+                SimClock::idle();
+            }
+        }
+    };
+    const auto end_us = static_cast<uint64_t>(seconds * 1e6);
+    runUntil(end_us, [] { return false; });
+    const auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    // Give the pedal up to ten more seconds to finish saving.
+    auto& store = hardware.Settings();
+    runUntil(end_us + 10000000, [&] {
+        return !pedal->savePending() && store.idle();
+    });
+
+    const auto simulated = hardware.micros() / 1e6;
+    std::fprintf(stderr,
+        "simulated %.1f s at %.0f Hz in %.3f s (%.0fx real time)\n",
+        simulated, sample_rate, elapsed,
+        elapsed > 0 ? seconds / elapsed : 0.0);
+    std::fprintf(stderr, "LED changes: enable %llu, preset %llu\n",
+        static_cast<unsigned long long>(hardware.leds[0].changes()),
+        static_cast<unsigned long long>(hardware.leds[1].changes()));
+    std::fprintf(stderr, "flash: %llu sector erases, %llu writes, "
+        "%lu errors\n",
+        static_cast<unsigned long long>(hardware.flash().erases()),
+        static_cast<unsigned long long>(hardware.flash().writes()),
+        static_cast<unsigned long>(store.errors()));
+    const auto& params = pedal->params();
+    std::fprintf(stderr, "effect %s, preset %s, modulation %s, "
+        "mod duration %.0f ms\n",
+        params.enable_effect ? "on" : "bypassed",
+        params.use_preset ? "on" : "off",
+        params.apply_mod ? "on" : "off", params.mod_duration);
+
+    // The saved settings, read back as the pedal would at the next boot
+    auto image = hardware.flash();
+    PersistentSettings<RamFlash> reloaded(image);
+    const auto saved = pedal->settings();
+    const auto loaded = reloaded.load();
+    const auto saved_ratios = saved.preset.ratios();
+    const auto loaded_ratios = loaded.preset.ratios();
+    bool settings_ok = !pedal->savePending() && store.idle() &&
+        store.errors() == 0 && loaded.mod_duration == saved.mod_duration;
+    for (size_t i = 0; i < saved_ratios.size(); ++i)
+    {
+        // Stored to 12 bits
+        settings_ok &= std::abs(std::clamp(saved_ratios[i], 0.0f, 1.0f) -
+            loaded_ratios[i]) <= 0.5f / 4095 + 1e-6f;
+    }
+    std::fprintf(stderr, "settings reload %s, %llu non-finite samples\n",
+        settings_ok ? "ok" : "wrong",
+        static_cast<unsigned long long>(nonfinite));
+
+    if (!flash_path.empty() && !hardware.flash().save(flash_path))
+    {
+        std::fprintf(stderr, "can't write %s\n", flash_path.c_str());
+        return EXIT_FAILURE;
+    }
+    if (telemetry) { std::fclose(telemetry); }
+
+    return (settings_ok && nonfinite == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
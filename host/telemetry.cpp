@@ -0,0 +1,81 @@
+// Turns the pedal's telemetry stream into CSV.
+//
+// Usage: terrarium-telemetry [input]
+//
+// Reads the binary stream from a file, or from standard input if there's
+// none or it's -, and prints one CSV line per record. Anything between
+// frames, such as log text sharing the port, is skipped. A summary goes
+// to standard error at the end.
+//
+// To read the pedal directly, put its port in raw mode first:
+//
+//   stty -F /dev/ttyACM0 raw && terrarium-telemetry /dev/ttyACM0
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <util/Telemetry.h>
+
+namespace
+{
+
+void print(const TelemetryRecord& r)
+{
+    const auto flag = [&r](uint8_t f) { return (r.flags & f) ? 1 : 0; };
+    std::printf("%lu,%.2f,%d,%d,%d,%.4f,%.4f,%lu,%u,%u\n",
+        static_cast<unsigned long>(r.time), r.frequency,
+        flag(TelemetryRecord::note_shift), flag(TelemetryRecord::gate_open),
+        flag(TelemetryRecord::gate_opened), r.envelope, r.mod_ratio,
+        static_cast<unsigned long>(r.cycles), r.blocks, r.dropped);
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 2)
+    {
+        std::fputs("usage: terrarium-telemetry [input]\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    auto* input = stdin;
+    if (argc == 2 && std::strcmp(argv[1], "-") != 0)
+    {
+        input = std::fopen(argv[1], "rb");
+        if (!input)
+        {
+            std::fprintf(stderr, "can't read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::puts("time,frequency,note_shift,gate_open,gate_opened,envelope,"
+        "mod_ratio,cycles,blocks,dropped");
+
+    TelemetryParser parser;
+    size_t records = 0;
+    uint16_t first_dropped = 0;
+    uint16_t last_dropped = 0;
+    // A byte at a time, so a live port's records show as they come,
+    // rather than once a buffer fills
+    uint8_t byte;
+    while (std::fread(&byte, 1, 1, input) == 1)
+    {
+        parser.feed(&byte, 1, [&](const TelemetryRecord& r) {
+            if (records++ == 0) { first_dropped = r.dropped; }
+            last_dropped = r.dropped;
+            print(r);
+        });
+    }
+
+    std::fprintf(stderr,
+        "%zu records, %u dropped on the pedal, %zu bytes skipped, "
+        "%zu bad frames\n",
+        records, static_cast<unsigned>(
+            static_cast<uint16_t>(last_dropped - first_dropped)),
+        parser.skipped(), parser.bad());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#include "Analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <q/support/literals.hpp>
+#include <q/support/pitch_names.hpp>
+
+#include <util/Tcm.h>
+
+namespace q = cycfi::q;
+using namespace q::literals;
+
+namespace
+{
+
+constexpr auto min_freq = q::pitch_names::Ds[2];
+constexpr auto max_freq = q::pitch_names::F[6];
+constexpr auto hysteresis = -35_dB;
+
+size_t validDecimation(size_t decimation)
+{
+    return (decimation >= 4) ? 4 : (decimation >= 2) ? 2 : 1;
+}
+
+size_t decimatorDelay(size_t decimation)
+{
+    constexpr auto stage_delay = HalfBandDecimator<>::delay;
+    return (decimation == 4) ? stage_delay * 3 :
+        (decimation == 2) ? stage_delay :
+        0;
+}
+
+} // namespace
+
+
+Analyzer::Analyzer(float sample_rate, size_t decimation) :
+    _decimation(validDecimation(decimation)),
+    _delay(decimatorDelay(_decimation)),
+    _step(1.0f / _decimation),
+    _pd(min_freq, max_freq, sample_rate / _decimation, hysteresis),
+    _envelope_follower(10_ms, sample_rate / _decimation),
+    _gate(-120_dB)
+{
+}
+
+void Analyzer::setTrigger(float onset)
+{
+    _gate.onset_threshold(onset);
+    _gate.release_threshold(q::lin_to_db(onset) - 12_dB);
+}
+
+TCM_CODE bool Analyzer::decimate(float x, float& out)
+{
+    if (_decimation == 1)
+    {
+        out = x;
+        return true;
+    }
+
+    float half = 0;
+    if (!_first_half.push(x, half)) { return false; }
+    if (_decimation == 2)
+    {
+        out = half;
+        return true;
+    }
+    return _second_half.push(half, out);
+}
+
+TCM_CODE void Analyzer::process(
+    const float* in, size_t size)
+{
+    _event_count = 0;
+    _note_shift = false;
+    _gate_opened = false;
+    _retrigger_index = 0;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        _group_peak = std::max(_group_peak, std::abs(in[i]));
+
+        float x = 0;
+        if (decimate(in[i], x))
+        {
+            if (_pd(x))
+            {
+                // Undo the decimator delay as far as this block allows.
+                const auto index = (i > _delay) ? (i - _delay) : 0;
+                _events[_event_count++] = {
+                    static_cast<uint32_t>(index), _pd.get_frequency()};
+                if (_pd.is_note_shift())
+                {
+                    _note_shift = true;
+                    _retrigger_index = std::max(_retrigger_index, index);
+                }
+            }
+        }
+
+        if (++_group_pos == _decimation)
+        {
+            _group_pos = 0;
+            _envelope_begin = _envelope_end;
+            _envelope_end = _envelope_follower(_group_peak);
+            _group_peak = 0;
+            _gate_open = _gate(_envelope_end);
+            if (_gate_rising(_gate_open))
+            {
+                _gate_opened = true;
+                _retrigger_index = i;
+            }
+        }
+
+        // Interpolate from the previous group's envelope to the latest.
+        const auto t = (_group_pos + 1) * _step;
+        _envelope[i] =
+            _envelope_begin + (t * (_envelope_end - _envelope_begin));
+        _gate_state[i] = _gate_open;
+    }
+}
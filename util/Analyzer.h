@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <q/fx/edge.hpp>
+#include <q/fx/envelope.hpp>
+#include <q/fx/noise_gate.hpp>
+#include <q/pitch/pitch_detector.hpp>
+
+#include <util/HalfBand.h>
+
+// Pitch detection, envelope following and gating of the dry signal.
+//
+// The analysis can run at a half or a quarter of the audio rate, since
+// nothing it tracks is anywhere near Nyquist. The pitch detector is fed
+// through half-band decimators, and its note events are moved earlier by
+// the decimators' delay so they still line up with the audio. The envelope
+// follower sees the peak of each group of input samples, and its output
+// is interpolated back up to the audio rate.
+class Analyzer
+{
+public:
+    static constexpr size_t max_block_size = 64;
+
+    // A new pitch from the detector, to apply before the sample at index.
+    struct PitchEvent
+    {
+        uint32_t index;
+        float frequency;
+    };
+
+    // decimation: 1, 2 or 4
+    Analyzer(float sample_rate, size_t decimation = 1);
+
+    // Gate thresholds as a linear level. The gate closes 12 dB lower.
+    void setTrigger(float onset);
+
+    // Analyzes a block of at most max_block_size samples.
+    void process(const float* in, size_t size);
+
+    // Results for the last block
+    const float* envelope() const { return _envelope.data(); }
+    const bool* gate() const { return _gate_state.data(); }
+    const PitchEvent* pitchEvents() const { return _events.data(); }
+    size_t pitchEventCount() const { return _event_count; }
+    bool noteShift() const { return _note_shift; }
+    bool gateOpened() const { return _gate_opened; }
+    // Index of the last note shift or gate opening, if there was one
+    size_t retriggerIndex() const { return _retrigger_index; }
+
+    float frequency() const { return _pd.get_frequency(); }
+    size_t decimation() const { return _decimation; }
+
+    // Delay of the pitch detector input, in audio samples
+    size_t delay() const { return _delay; }
+
+private:
+    // Returns true when x completes a group, with out holding the
+    // decimated sample.
+    bool decimate(float x, float& out);
+
+    const size_t _decimation;
+    const size_t _delay;
+    const float _step;
+
+    HalfBandDecimator<> _first_half;
+    HalfBandDecimator<> _second_half;
+    size_t _group_pos = 0;
+    float _group_peak = 0;
+
+    // q allocates its buffers on the heap, which leaves them in AXI SRAM
+    // when the analyzer is in DTCM: a bit per sample over two periods of
+    // the lowest note, and the recent zero crossings, about 1 KB.
+    cycfi::q::pitch_detector _pd;
+    cycfi::q::peak_envelope_follower _envelope_follower;
+    cycfi::q::noise_gate _gate;
+    cycfi::q::rising_edge _gate_rising;
+    bool _gate_open = false;
+    float _envelope_begin = 0;
+    float _envelope_end = 0;
+
+    std::array<float, max_block_size> _envelope;
+    std::array<bool, max_block_size> _gate_state;
+    std::array<PitchEvent, max_block_size> _events;
+    size_t _event_count = 0;
+    bool _note_shift = false;
+    bool _gate_opened = false;
+    size_t _retrigger_index = 0;
+};
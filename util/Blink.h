@@ -1,34 +1,37 @@
 #pragma once
 
-#include <daisy_seed.h>
+#include <cstdint>
 
+// Flashes an LED a few times. Times are counts of samples, from the same
+// clock as the audio.
 class Blink
 {
 public:
+    explicit Blink(uint64_t interval) : _interval(interval) {}
+
     bool enabled() const
     {
         return !_expired;
     }
 
-    void reset()
+    void reset(uint64_t now)
     {
         _expired = false;
-        _start_ms = daisy::System::GetNow();
+        _start = now;
     }
 
-    bool process()
+    bool process(uint64_t now)
     {
         if (_expired) return false;
-        const auto elapsed_ms = daisy::System::GetNow() - _start_ms;
-        const auto count = elapsed_ms / interval_ms;
+        const auto count = (now - _start) / _interval;
         _expired = (count > max_count);
-        return !_expired && (elapsed_ms / interval_ms) % 2;
+        return !_expired && count % 2;
     }
 
 private:
-    static constexpr int max_count = 6;
-    static constexpr uint32_t interval_ms = 125;
+    static constexpr uint64_t max_count = 6;
 
+    const uint64_t _interval;
     bool _expired = true;
-    uint32_t _start_ms = 0;
+    uint64_t _start = 0;
 };
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include <util/EffectState.h>
+
+// Derived values of an EffectState, recomputed only when the ratios they
+// depend on have moved. Small changes are ignored until they add up, so
+// ADC noise on a resting knob doesn't count as movement.
+class EffectCache
+{
+public:
+    explicit EffectCache(float sample_rate) : _sample_rate(sample_rate) {}
+
+    // Flags returned by update()
+    static constexpr uint32_t levels_changed = 1 << 0;
+    static constexpr uint32_t shape_changed = 1 << 1;
+    static constexpr uint32_t noise_changed = 1 << 2;
+    static constexpr uint32_t filter_changed = 1 << 3;
+
+    // Brings the cache up to date with the given state and detected pitch.
+    // Returns the flags of the derived values that changed.
+    uint32_t update(const EffectState& s, float frequency)
+    {
+        uint32_t changed = 0;
+        const bool first = !_valid;
+        _valid = true;
+
+        const auto pitch_change = std::abs(frequency - _frequency);
+        const bool pitch_moved =
+            first || (pitch_change > (_frequency * pitch_tolerance));
+        if (pitch_moved)
+        {
+            _frequency = frequency;
+        }
+
+        if (first || moved(s._dry_ratio, _state._dry_ratio))
+        {
+            _state._dry_ratio = s._dry_ratio;
+            _dry_level = _state.dryLevel();
+            _recomputes++;
+            changed |= levels_changed;
+        }
+
+        if (first || moved(s._synth_ratio, _state._synth_ratio))
+        {
+            _state._synth_ratio = s._synth_ratio;
+            _synth_level = _state.synthLevel();
+            _recomputes++;
+            changed |= levels_changed;
+        }
+
+        const bool wave_moved =
+            first || moved(s._wave_ratio, _state._wave_ratio);
+        if (wave_moved)
+        {
+            _state._wave_ratio = s._wave_ratio;
+            _wave_shape = _state.waveShape();
+            _recomputes++;
+            changed |= shape_changed;
+        }
+
+        if (wave_moved || pitch_moved)
+        {
+            _noise_sample_duration = _state.noiseSampleDuration(_frequency);
+            _recomputes++;
+            changed |= noise_changed;
+        }
+
+        const bool filter_moved =
+            first || moved(s._filter_ratio, _state._filter_ratio);
+        if (filter_moved || pitch_moved)
+        {
+            _state._filter_ratio = s._filter_ratio;
+            _low_pass_corner =
+                _state.lowPassCorner(_frequency, _sample_rate);
+            _high_pass_corner =
+                _state.highPassCorner(_frequency, _sample_rate);
+            _recomputes += 2;
+            changed |= filter_changed;
+        }
+
+        if (first || moved(s._resonance_ratio, _state._resonance_ratio))
+        {
+            _state._resonance_ratio = s._resonance_ratio;
+            _resonance = _state.resonance();
+            _recomputes++;
+            changed |= filter_changed;
+        }
+
+        // These are plain copies, so there's nothing to save by caching.
+        _state._noise_ratio = s._noise_ratio;
+        _state._envelope_ratio = s._envelope_ratio;
+
+        return changed;
+    }
+
+    float dryLevel() const { return _dry_level; }
+    float synthLevel() const { return _synth_level; }
+    float waveShape() const { return _wave_shape; }
+    float resonance() const { return _resonance; }
+    float waveMix() const { return _state.waveMix(); }
+    float noiseMix() const { return _state.noiseMix(); }
+    float envelopeInfluence() const { return _state.envelopeInfluence(); }
+    float noiseSampleDuration() const { return _noise_sample_duration; }
+    float lowPassCorner() const { return _low_pass_corner; }
+    float highPassCorner() const { return _high_pass_corner; }
+    float lowPassMix() const { return _state.lowPassMix(); }
+    float highPassMix() const { return _state.highPassMix(); }
+
+    // Total number of derived values computed so far.
+    uint32_t recomputeCount() const { return _recomputes; }
+
+private:
+    // Half a step of a 12-bit ADC.
+    static constexpr float ratio_tolerance = 1.0f / 8192;
+    // About two cents
+    static constexpr float pitch_tolerance = 0.001f;
+
+    static bool moved(float value, float cached)
+    {
+        return std::abs(value - cached) > ratio_tolerance;
+    }
+
+    const float _sample_rate;
+    bool _valid = false;
+    EffectState _state;
+    float _frequency = 0;
+
+    float _dry_level = 0;
+    float _synth_level = 0;
+    float _wave_shape = 0;
+    float _resonance = 0;
+    float _noise_sample_duration = 0;
+    float _low_pass_corner = 0;
+    float _high_pass_corner = 0;
+
+    uint32_t _recomputes = 0;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <numbers>
+#include <utility>
+
+// In-place radix-2 FFT. size must be a power of two. The inverse transform
+// is not normalized.
+template <typename T>
+void fft(std::complex<T>* data, size_t size, bool inverse = false)
+{
+    for (size_t i = 1, j = 0; i < size; ++i)
+    {
+        auto bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    constexpr auto pi = std::numbers::pi_v<T>;
+    for (size_t length = 2; length <= size; length <<= 1)
+    {
+        const auto angle = (inverse ? 2 : -2) * pi / length;
+        const std::complex<T> step(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < size; i += length)
+        {
+            std::complex<T> w(1);
+            for (size_t j = 0; j < length / 2; ++j)
+            {
+                const auto u = data[i + j];
+                const auto v = data[i + j + length / 2] * w;
+                data[i + j] = u + v;
+                data[i + j + length / 2] = u - v;
+                w *= step;
+            }
+        }
+    }
+}
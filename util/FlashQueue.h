@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Defers erases and writes to a Flash and carries them out a little at a
+// time, so no single call blocks for long. It has the same interface as
+// the Flash it wraps, so a PresetBank can save through it: erase and write
+// only queue the work, and return false if there isn't room.
+//
+// step() does the next piece of work: erasing one sector or programming
+// up to one page. Call it regularly from the control loop. Work is done in
+// the order it was queued, so a bank's header still lands after the
+// records it covers.
+//
+// Work that still fails after max_attempts is dropped, along with
+// everything queued behind it, which may depend on it: records on the
+// erase before them, a header on its records. errors() counts the drops,
+// and a PresetBank saving through the queue rewrites itself when it moves.
+//
+// data() shows the flash as it is, without the work still queued.
+template <typename Flash, size_t Capacity = 2048, size_t MaxOps = 16>
+class FlashQueue
+{
+public:
+    static constexpr size_t sector_size = Flash::sector_size;
+    static constexpr size_t page_size = 256;
+    // Times a step is tried before its work is dropped
+    static constexpr uint32_t max_attempts = 3;
+
+    // Writes only queue the work, and one the queue has no room for
+    // programs nothing.
+    static constexpr bool queues_work = true;
+
+    explicit FlashQueue(Flash& flash) : _flash(flash) {}
+
+    size_t size() const { return _flash.size(); }
+    const uint8_t* data() const { return _flash.data(); }
+
+    bool erase(size_t offset, size_t size)
+    {
+        const auto first = offset / sector_size;
+        const auto last = (offset + size + sector_size - 1) / sector_size;
+        if (_op_count + (last - first) > MaxOps) { return false; }
+        for (auto s = first; s < last; ++s)
+        {
+            push({Op::erase, s * sector_size, sector_size, 0});
+        }
+        return true;
+    }
+
+    bool write(size_t offset, const uint8_t* data, size_t size)
+    {
+        if (!reserve(size)) { return false; }
+
+        // Join a write that carries on from the last one.
+        auto* last = _op_count ? &_ops[(_op_head + _op_count - 1) % MaxOps]
+            : nullptr;
+        const bool joins = last && last->kind == Op::write &&
+            last->offset + last->size == offset &&
+            last->data + last->size == _data_end;
+        if (!joins)
+        {
+            if (_op_count == MaxOps) { return false; }
+            push({Op::write, offset, 0, _data_end});
+            last = &_ops[(_op_head + _op_count - 1) % MaxOps];
+        }
+
+        std::copy_n(data, size, _data.begin() + _data_end);
+        _data_end += size;
+        last->size += size;
+        return true;
+    }
+
+    bool idle() const { return _op_count == 0; }
+
+    // Sectors left to erase and bytes left to write
+    size_t pendingErases() const
+    {
+        size_t count = 0;
+        forEachOp([&](const Op& op) { count += op.kind == Op::erase; });
+        return count;
+    }
+    size_t pendingBytes() const { return _data_end - _data_begin; }
+
+    // Times queued work was dropped after failing max_attempts times
+    uint32_t errors() const { return _errors; }
+
+    // Does the next piece of queued work. Returns false if it failed, in
+    // which case it's tried again on the next call, or dropped with the
+    // rest of the queue once it has failed max_attempts times.
+    bool step()
+    {
+        if (idle()) { return true; }
+
+        auto& op = _ops[_op_head];
+        bool ok;
+        size_t done;
+        if (op.kind == Op::erase)
+        {
+            done = op.size;
+            ok = _flash.erase(op.offset, done);
+        }
+        else
+        {
+            // Up to the end of the page
+            done = std::min(op.size, page_size - (op.offset % page_size));
+            ok = _flash.write(op.offset, _data.data() + op.data, done);
+        }
+
+        if (!ok && ++_attempts < max_attempts) { return false; }
+        _attempts = 0;
+        if (!ok)
+        {
+            _errors++;
+            clear();
+            return false;
+        }
+
+        if (op.kind == Op::write)
+        {
+            _data_begin += done;
+            op.data += done;
+        }
+        op.offset += done;
+        op.size -= done;
+        if (op.size == 0) { pop(); }
+        return true;
+    }
+
+private:
+    struct Op
+    {
+        enum Kind : uint8_t { erase, write };
+
+        Kind kind;
+        size_t offset;
+        size_t size;
+        // Start in _data, for writes
+        size_t data;
+    };
+
+    void push(const Op& op)
+    {
+        _ops[(_op_head + _op_count) % MaxOps] = op;
+        _op_count++;
+    }
+
+    void pop()
+    {
+        const auto& op = _ops[_op_head];
+        if (op.kind == Op::write) { _data_begin = op.data + op.size; }
+        _op_head = (_op_head + 1) % MaxOps;
+        _op_count--;
+        if (idle()) { _data_begin = _data_end = 0; }
+    }
+
+    void clear()
+    {
+        _op_head = 0;
+        _op_count = 0;
+        _data_begin = _data_end = 0;
+    }
+
+    // Makes room for size more bytes, moving the queued data down to the
+    // start of the buffer if that's needed.
+    bool reserve(size_t size)
+    {
+        if (_data_end + size <= Capacity) { return true; }
+        if (pendingBytes() + size > Capacity) { return false; }
+
+        std::copy(_data.begin() + _data_begin, _data.begin() + _data_end,
+            _data.begin());
+        forEachOp([&](Op& op) {
+            if (op.kind == Op::write) { op.data -= _data_begin; }
+        });
+        _data_end -= _data_begin;
+        _data_begin = 0;
+        return true;
+    }
+
+    template <typename F>
+    void forEachOp(F&& f)
+    {
+        for (size_t i = 0; i < _op_count; ++i)
+        {
+            f(_ops[(_op_head + i) % MaxOps]);
+        }
+    }
+
+    template <typename F>
+    void forEachOp(F&& f) const
+    {
+        for (size_t i = 0; i < _op_count; ++i)
+        {
+            f(_ops[(_op_head + i) % MaxOps]);
+        }
+    }
+
+    Flash& _flash;
+    std::array<Op, MaxOps> _ops{};
+    size_t _op_head = 0;
+    size_t _op_count = 0;
+    std::array<uint8_t, Capacity> _data{};
+    size_t _data_begin = 0;
+    size_t _data_end = 0;
+    uint32_t _attempts = 0;
+    uint32_t _errors = 0;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <numbers>
+
+#include <gcem.hpp>
+
+// Coefficients of a half-band low-pass FIR with the given odd number of
+// taps: a Blackman-windowed sinc cut off at a quarter of the sample rate.
+// Every other tap apart from the center one is zero.
+template <size_t Taps>
+constexpr std::array<float, Taps> halfBandCoefficients()
+{
+    static_assert(Taps % 4 == 3, "half-band filters have 4n+3 taps");
+    constexpr auto pi = std::numbers::pi;
+    constexpr auto center = static_cast<int>(Taps / 2);
+
+    std::array<double, Taps> h{};
+    double sum = 0;
+    for (int i = 0; i < static_cast<int>(Taps); ++i)
+    {
+        const auto n = i - center;
+        const auto x = 2 * pi * n / (Taps + 1);
+        const auto window =
+            0.42 + (0.5 * gcem::cos(x)) + (0.08 * gcem::cos(2 * x));
+        const auto sinc = (n == 0) ? 0.5 :
+            (n % 2 == 0) ? 0.0 :
+            gcem::sin(pi * n / 2) / (pi * n);
+        h[i] = sinc * window;
+        sum += h[i];
+    }
+
+    std::array<float, Taps> coefficients{};
+    for (size_t i = 0; i < Taps; ++i)
+    {
+        coefficients[i] = static_cast<float>(h[i] / sum);
+    }
+    return coefficients;
+}
+
+// Halves the sample rate through a half-band FIR. Only the non-zero taps
+// are evaluated, and only for the samples that are kept.
+template <size_t Taps = 19>
+class HalfBandDecimator
+{
+public:
+    // Group delay, in input samples
+    static constexpr size_t delay = Taps / 2;
+
+    // Returns true on every second sample, when out holds the next output.
+    bool push(float x, float& out)
+    {
+        _history[_pos] = x;
+        _history[_pos + Taps] = x;
+        _pos = (_pos + 1) % Taps;
+        _odd = !_odd;
+        if (_odd) { return false; }
+
+        // _history[_pos] is now the oldest sample.
+        const auto* h = &_history[_pos];
+        float sum = h[delay] * coefficients[delay];
+        for (size_t i = 1; i <= delay; i += 2)
+        {
+            sum += (h[delay - i] + h[delay + i]) * coefficients[delay + i];
+        }
+        out = sum;
+        return true;
+    }
+
+private:
+    static constexpr auto coefficients = halfBandCoefficients<Taps>();
+
+    // Each sample is written twice so the taps can be read without
+    // wrapping around.
+    std::array<float, 2 * Taps> _history{};
+    size_t _pos = 0;
+    bool _odd = false;
+};
+
+// Brings a signal oversampled by 1, 2 or 4 back down to the base rate, one
+// half-band stage per halving. The first of two stages only has to keep
+// what the second one passes, so it can be shorter.
+class OversamplingDecimator
+{
+public:
+    static constexpr size_t max_factor = 4;
+
+    // The supported factor nearest to factor, rounding down
+    static constexpr size_t nearestFactor(size_t factor)
+    {
+        return (factor >= 4) ? 4 : (factor >= 2) ? 2 : 1;
+    }
+
+    // Also clears the filters.
+    void setFactor(size_t factor)
+    {
+        _factor = nearestFactor(factor);
+        _first = {};
+        _last = {};
+    }
+
+    size_t factor() const { return _factor; }
+
+    // Group delay, in base rate samples
+    float delay() const
+    {
+        if (_factor == 4)
+        {
+            return (First::delay / 4.0f) + (Last::delay / 2.0f);
+        }
+        return (_factor == 2) ? (Last::delay / 2.0f) : 0;
+    }
+
+    // in holds size * factor() samples. out may be the same as in.
+    void process(const float* in, float* out, size_t size)
+    {
+        if (_factor == 1)
+        {
+            if (in != out) { std::copy_n(in, size, out); }
+            return;
+        }
+
+        const auto in_size = size * _factor;
+        size_t o = 0;
+        float y;
+        if (_factor == 2)
+        {
+            for (size_t i = 0; i < in_size; ++i)
+            {
+                if (_last.push(in[i], y)) { out[o++] = y; }
+            }
+            return;
+        }
+
+        float x;
+        for (size_t i = 0; i < in_size; ++i)
+        {
+            if (_first.push(in[i], x) && _last.push(x, y)) { out[o++] = y; }
+        }
+    }
+
+private:
+    using First = HalfBandDecimator<11>;
+    using Last = HalfBandDecimator<31>;
+
+    size_t _factor = 1;
+    First _first;
+    Last _last;
+};
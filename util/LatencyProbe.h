@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Measures the round trip from the audio output back to the input, with a
+// cable from the output jack to the input. It replaces the audio callback:
+// a click goes out every period samples, and the time until the input
+// crosses the threshold is the latency, counting the block buffering on
+// both sides along with the converters.
+class LatencyProbe
+{
+public:
+    explicit LatencyProbe(size_t period = 24000, float threshold = 0.25f) :
+        _period(period), _threshold(threshold)
+    {}
+
+    void process(const float* in, float* out, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i, ++_time)
+        {
+            if (_waiting && std::abs(in[i]) > _threshold)
+            {
+                record(_time - _sent);
+                _waiting = false;
+            }
+
+            out[i] = 0;
+            if (_time % _period == 0)
+            {
+                out[i] = 1;
+                // A click that never came back counts as lost.
+                _lost += _waiting;
+                _sent = _time;
+                _waiting = true;
+            }
+        }
+    }
+
+    // Round trips measured, and clicks that didn't come back within a
+    // period
+    uint32_t count() const { return _count; }
+    uint32_t lost() const { return _lost; }
+
+    // In samples; 0 before the first measurement
+    uint32_t last() const { return _last; }
+    uint32_t min() const { return _count ? _min : 0; }
+    uint32_t max() const { return _max; }
+
+    void reset()
+    {
+        _count = _lost = _last = _max = 0;
+        _min = std::numeric_limits<uint32_t>::max();
+    }
+
+private:
+    void record(uint64_t samples)
+    {
+        _last = static_cast<uint32_t>(samples);
+        _min = std::min(_min, _last);
+        _max = std::max(_max, _last);
+        _count++;
+    }
+
+    const size_t _period;
+    const float _threshold;
+    uint64_t _time = 0;
+    uint64_t _sent = 0;
+    bool _waiting = false;
+    uint32_t _count = 0;
+    uint32_t _lost = 0;
+    uint32_t _last = 0;
+    uint32_t _min = std::numeric_limits<uint32_t>::max();
+    uint32_t _max = 0;
+};
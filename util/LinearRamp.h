@@ -1,12 +1,21 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 
+// Moves toward a target by a fixed step per call.
 class LinearRamp
 {
 public:
     LinearRamp(float value, float step) : _value(value), _step(step) {}
 
+    // Step that covers a change of 1 in the given time, for a ramp called
+    // rate times a second.
+    static float stepFor(float seconds, float rate)
+    {
+        return 1 / std::max(seconds * rate, 1.0f);
+    }
+
     float operator()(float target)
     {
         if (_value > target)
@@ -23,7 +32,73 @@ public:
         return _value;
     }
 
+    // Takes steps steps at once, for a ramp called less often than its
+    // rate.
+    float operator()(float target, size_t steps)
+    {
+        const auto step = _step * steps;
+        _value = (_value > target) ?
+            std::max(_value - step, target) :
+            std::min(_value + step, target);
+        return _value;
+    }
+
 private:
     float _value;
     float _step;
 };
+
+// Reaches each new target in a straight line over a given number of
+// samples, usually one block. The increment is worked out once per target,
+// so each sample costs an add.
+class BlockRamp
+{
+public:
+    explicit BlockRamp(float value = 0) : _value(value), _target(value) {}
+
+    void setTarget(float target, size_t samples)
+    {
+        _target = target;
+        _remaining = std::max<size_t>(samples, 1);
+        _increment = (target - _value) / _remaining;
+    }
+
+    // Jumps straight to value.
+    void reset(float value)
+    {
+        _value = _target = value;
+        _remaining = 0;
+    }
+
+    bool ramping() const { return _remaining > 0; }
+    float value() const { return _value; }
+    float target() const { return _target; }
+
+    // Returns the value for the next sample.
+    float operator()()
+    {
+        return advance(1);
+    }
+
+    // Moves on by samples, and returns the value reached.
+    float advance(size_t samples)
+    {
+        if (samples >= _remaining)
+        {
+            _value = _target;
+            _remaining = 0;
+        }
+        else
+        {
+            _value += _increment * samples;
+            _remaining -= samples;
+        }
+        return _value;
+    }
+
+private:
+    float _value;
+    float _target;
+    float _increment = 0;
+    size_t _remaining = 0;
+};
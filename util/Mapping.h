@@ -1,7 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
 
 #include <gcem.hpp>
 #include <q/detail/fast_math.hpp>
@@ -54,6 +56,13 @@ public:
         return fasterexp(_log_range*x + _log_min) - _offset;
     }
 
+    // As operator(), with an exact exp. Usable at compile time, but slow
+    // at run time.
+    constexpr float exact(float x) const
+    {
+        return gcem::exp(_log_range*x + _log_min) - _offset;
+    }
+
 private:
     static constexpr float calculateOffset(float min, float center, float max)
     {
@@ -64,3 +73,46 @@ private:
     const float _log_min;
     const float _log_range;
 };
+
+// A mapping evaluated from a table of N straight segments, built at
+// compile time from the mapping's exact() curve. A lookup is an index and
+// a multiply-add, with no transcendental call. The error falls with the
+// square of N; terrarium-bench mapping lists it against the table size.
+template <size_t N>
+class TableMapping
+{
+public:
+    static_assert(N >= 1);
+
+    static constexpr size_t memory_size = N * 2 * sizeof(float);
+
+    template <typename Mapping>
+    explicit constexpr TableMapping(const Mapping& mapping)
+    {
+        auto begin = mapping.exact(0);
+        for (size_t i = 0; i < N; ++i)
+        {
+            const auto end = mapping.exact(static_cast<float>(i + 1) / N);
+            _segments[i] = {begin, end - begin};
+            begin = end;
+        }
+    }
+
+    // 0 <= x <= 1
+    float operator()(float x) const
+    {
+        const auto position = std::clamp(x, 0.0f, 1.0f) * N;
+        const auto i = std::min(static_cast<size_t>(position), N - 1);
+        const auto& segment = _segments[i];
+        return segment.start + ((position - i) * segment.slope);
+    }
+
+private:
+    struct Segment
+    {
+        float start;
+        float slope;
+    };
+
+    std::array<Segment, N> _segments{};
+};
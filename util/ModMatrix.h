@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include <q/support/phase.hpp>
+#include <q/synth/sin_osc.hpp>
+
+// Where modulation comes from. Every source runs from 0 to 1.
+enum class ModSource : uint8_t
+{
+    lfo1,
+    lfo2,
+    // The dry signal's envelope
+    envelope,
+    count
+};
+
+// What modulation moves, and the unit of a route's amount for each
+enum class ModDestination : uint8_t
+{
+    // Both filter corners, in octaves
+    filter,
+    // Wave shape, where 3 covers the whole range
+    shape,
+    // Shares of the level: -1 silences it, 1 doubles it
+    dry_level,
+    synth_level,
+    // Noise sample rate, in octaves
+    noise_rate,
+    count
+};
+
+struct LfoSettings
+{
+    enum class Shape : uint8_t
+    {
+        sine,
+        triangle,
+        ramp,
+        sample_hold
+    };
+
+    Shape shape = Shape::sine;
+    float frequency = 1; // Hz
+    // Repeats, rather than stopping at its peak
+    bool cycle = true;
+    // Restarts on a note shift or when the gate opens
+    bool retrigger = true;
+
+    bool operator==(const LfoSettings&) const = default;
+};
+
+struct ModRoute
+{
+    ModSource source = ModSource::lfo1;
+    ModDestination destination = ModDestination::filter;
+    float amount = 0;
+
+    bool operator==(const ModRoute&) const = default;
+};
+
+struct ModSettings
+{
+    static constexpr size_t lfo_count = 2;
+    static constexpr size_t max_routes = 8;
+
+    std::array<LfoSettings, lfo_count> lfos{};
+    std::array<ModRoute, max_routes> routes{};
+    size_t route_count = 0;
+
+    // Returns false if every route is taken.
+    bool add(const ModRoute& route)
+    {
+        if (route_count == max_routes) { return false; }
+        routes[route_count++] = route;
+        return true;
+    }
+
+    bool operator==(const ModSettings&) const = default;
+};
+
+// A low frequency oscillator from 0 to 1, moved on by a phase increment
+// per sample, so its timing is exact however many samples a call covers.
+//
+// A one-shot stops at its peak: half way through the cycle for sine and
+// triangle, and at the end for ramp. Sample and hold keeps its first value.
+class Lfo
+{
+public:
+    using Shape = LfoSettings::Shape;
+
+    // seed picks the sample and hold sequence. It's spread over the bits,
+    // since xorshift takes a while to get going from a small number.
+    explicit Lfo(uint32_t seed = 1) : _random((seed * 0x9E3779B9u) | 1) {}
+
+    void set(const LfoSettings& settings, float sample_rate)
+    {
+        _shape = settings.shape;
+        _cycle = settings.cycle;
+        _step = cycfi::q::phase(
+            cycfi::q::frequency(settings.frequency), sample_rate);
+    }
+
+    // Back to the start of the cycle, running again if it had stopped
+    void restart()
+    {
+        _phase = cycfi::q::phase();
+        _running = true;
+        _held = nextRandom();
+    }
+
+    // Moves on by samples, restarting restart_at samples in if that's
+    // within them, and returns the value reached.
+    float advance(size_t samples, size_t restart_at)
+    {
+        if (restart_at >= samples) { return advance(samples); }
+        advance(restart_at);
+        restart();
+        return advance(samples - restart_at);
+    }
+
+    float advance(size_t samples)
+    {
+        if (!_running) { return value(); }
+
+        const auto end = static_cast<uint64_t>(_phase.rep) +
+            (static_cast<uint64_t>(_step.rep) * samples);
+        if (!_cycle && end >= peak())
+        {
+            _phase.rep = peak();
+            _running = false;
+        }
+        else
+        {
+            // Sample and hold takes a new value with each cycle.
+            if (end >> 32) { _held = nextRandom(); }
+            _phase.rep = static_cast<uint32_t>(end);
+        }
+        return value();
+    }
+
+    float value() const
+    {
+        constexpr float to_frac = 1.0f / 4294967296.0f;
+        const auto t = _phase.rep * to_frac;
+        switch (_shape)
+        {
+        case Shape::sine:
+            // Starts from its lowest point, like the others
+            return (cycfi::q::sin(_phase - cycfi::q::frac_to_phase(0.25)) +
+                1) / 2;
+        case Shape::triangle:
+            return 1 - std::abs((2 * t) - 1);
+        case Shape::ramp:
+            return t;
+        case Shape::sample_hold:
+            return _held;
+        }
+        return 0;
+    }
+
+private:
+    uint32_t peak() const
+    {
+        switch (_shape)
+        {
+        case Shape::sine:
+        case Shape::triangle:
+            return 0x80000000u;
+        case Shape::ramp:
+            return 0xFFFFFFFFu;
+        case Shape::sample_hold:
+            break;
+        }
+        return 0;
+    }
+
+    // xorshift32, from 0 to 1
+    float nextRandom()
+    {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        return (_random >> 8) * (1.0f / 16777216.0f);
+    }
+
+    Shape _shape = Shape::sine;
+    bool _cycle = true;
+    bool _running = true;
+    cycfi::q::phase _phase;
+    cycfi::q::phase _step;
+    float _held = 0;
+    uint32_t _random;
+};
+
+// Sums the sources into offsets for each destination. The routes are
+// folded into a gain from every source to every destination when the
+// settings change, so a block costs the same however many routes there
+// are. Offsets are worked out once every step samples.
+class ModMatrix
+{
+public:
+    static constexpr size_t max_block_size = 64;
+    static constexpr size_t step = 8;
+    static constexpr size_t max_steps = max_block_size / step;
+    static constexpr size_t source_count =
+        static_cast<size_t>(ModSource::count);
+    static constexpr size_t destination_count =
+        static_cast<size_t>(ModDestination::count);
+
+    explicit ModMatrix(float sample_rate) :
+        _sample_rate(sample_rate), _lfos{Lfo(1), Lfo(2)}
+    {}
+
+    void set(const ModSettings& settings)
+    {
+        for (size_t l = 0; l < ModSettings::lfo_count; ++l)
+        {
+            _lfos[l].set(settings.lfos[l], _sample_rate);
+            _retrigger[l] = settings.lfos[l].retrigger;
+        }
+
+        for (auto& gains : _gains) { gains.fill(0); }
+        for (size_t r = 0; r < settings.route_count; ++r)
+        {
+            const auto& route = settings.routes[r];
+            _gains[static_cast<size_t>(route.destination)]
+                [static_cast<size_t>(route.source)] += route.amount;
+        }
+        for (size_t d = 0; d < destination_count; ++d)
+        {
+            _active[d] = std::any_of(_gains[d].begin(), _gains[d].end(),
+                [](float gain) { return gain != 0; });
+            _values[d].fill(0);
+        }
+    }
+
+    // Runs the sources over a block of at most max_block_size samples.
+    // retrigger is the index of a note shift or gate opening in the block,
+    // or size if there wasn't one. envelope is the dry signal's, for each
+    // sample.
+    void process(size_t size, size_t retrigger, const float* envelope)
+    {
+        std::array<float, source_count> sources;
+        constexpr auto envelope_source =
+            static_cast<size_t>(ModSource::envelope);
+
+        for (size_t k = 0, begin = 0; begin < size; ++k, begin += step)
+        {
+            const auto length = std::min(step, size - begin);
+            const auto restart_at =
+                (retrigger >= begin) ? (retrigger - begin) : length;
+            for (size_t l = 0; l < ModSettings::lfo_count; ++l)
+            {
+                sources[l] = _retrigger[l] ?
+                    _lfos[l].advance(length, restart_at) :
+                    _lfos[l].advance(length);
+            }
+            sources[envelope_source] =
+                std::min(envelope[begin + length - 1], 1.0f);
+
+            for (size_t d = 0; d < destination_count; ++d)
+            {
+                float sum = 0;
+                for (size_t s = 0; s < source_count; ++s)
+                {
+                    sum += _gains[d][s] * sources[s];
+                }
+                _values[d][k] = sum;
+            }
+        }
+    }
+
+    // True if any route leads to the destination
+    bool active(ModDestination destination) const
+    {
+        return _active[static_cast<size_t>(destination)];
+    }
+
+    // Offsets for the last block, one for every step samples. All zero for
+    // a destination that isn't active.
+    const float* values(ModDestination destination) const
+    {
+        return _values[static_cast<size_t>(destination)].data();
+    }
+
+private:
+    const float _sample_rate;
+    std::array<Lfo, ModSettings::lfo_count> _lfos;
+    std::array<bool, ModSettings::lfo_count> _retrigger{};
+    std::array<std::array<float, source_count>, destination_count> _gains{};
+    std::array<bool, destination_count> _active{};
+    std::array<std::array<float, max_steps>, destination_count> _values{};
+};
@@ -0,0 +1,517 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#include <util/Blink.h>
+#include <util/EffectState.h>
+#include <util/LatencyProbe.h>
+#include <util/PersistentSettings.h>
+#include <util/Profiler.h>
+#include <util/SampleCounter.h>
+#include <util/Scheduler.h>
+#include <util/Snapshot.h>
+#include <util/SynthEngine.h>
+#include <util/TapTempo.h>
+#include <util/Tcm.h>
+#include <util/Telemetry.h>
+
+// Pitch and envelope analysis runs at half the audio rate.
+constexpr size_t analysis_decimation = 2;
+
+#ifndef TERRARIUM_BLOCK_SIZE
+#define TERRARIUM_BLOCK_SIZE 48
+#endif
+// Samples per audio callback. The round trip from input to output is
+// about two blocks plus the converters, so 2 to 8 suit tight picking.
+constexpr size_t audio_block_size = TERRARIUM_BLOCK_SIZE;
+static_assert(audio_block_size >= 1);
+
+#ifndef TERRARIUM_SAMPLE_RATE
+#define TERRARIUM_SAMPLE_RATE 48000
+#endif
+// The rates the pedal runs at. 32 kHz leaves the most time per sample for
+// voices and oversampling; 96 kHz halves the time each block takes, and
+// so the latency, against 48 kHz. The default holds until a rate is
+// chosen at power-up.
+constexpr std::array<uint32_t, 3> sample_rates{32000, 48000, 96000};
+constexpr uint32_t default_sample_rate = TERRARIUM_SAMPLE_RATE;
+static_assert(std::ranges::find(sample_rates, default_sample_rate) !=
+    sample_rates.end());
+
+#ifndef TERRARIUM_OVERSAMPLING
+#define TERRARIUM_OVERSAMPLING 1
+#endif
+// Rate multiple for the oscillator and filter. 2 or 4 keeps resonant
+// sweeps near the top of the band clean, at about twice or three times
+// the engine's cost.
+constexpr size_t oversampling = TERRARIUM_OVERSAMPLING;
+static_assert(oversampling == 1 || oversampling == 2 || oversampling == 4);
+
+#ifndef TERRARIUM_TELEMETRY
+#define TERRARIUM_TELEMETRY 0
+#endif
+// Audio blocks per telemetry record sent over USB, or 0 for none. Every
+// block at 48 samples and 48 kHz is 1000 records, 24 KB, a second.
+constexpr size_t telemetry_decimation = TERRARIUM_TELEMETRY;
+constexpr bool telemetry_enabled = telemetry_decimation > 0;
+
+// The pedal's audio callback and control loop, on any Hardware with the
+// interface of Terrarium: the knobs, switches and LEDs, a Scheduler clock,
+// the audio, the USB serial port and flash for the settings. Terrarium
+// drives the pedal; host/SimTerrarium.h runs the same code on Linux.
+template <typename Hardware>
+class Pedal
+{
+public:
+    using Clock = typename Hardware::Clock;
+
+    // Loads the settings, sets the sample rate and builds the engine.
+    // Initialize the hardware first.
+    explicit Pedal(Hardware& hardware) :
+        _hw(hardware),
+        _boot_us{hardware.Micros(), 0, 0, 0},
+        _settings(hardware.Settings().load()),
+        _sample_rate(chooseSampleRate()),
+        _telemetry(telemetry_decimation),
+        _blink(samples(125)),
+        _tempo(samples(_settings.mod_duration), samples(2000))
+    {
+        _params.preset_state = _settings.preset;
+        _params.mod_duration = _settings.mod_duration;
+        _params.oversampling = oversampling;
+        _boot_us.settings = _hw.Micros();
+
+        CycleCounter::init();
+        _engine.emplace(_sample_rate, analysis_decimation);
+        _boot_us.engine = _hw.Micros();
+
+        if constexpr (profiling_enabled || telemetry_enabled)
+        {
+            _hw.StartLog();
+        }
+
+        // Foot switches held at power-up do nothing until they're let
+        // go.
+        const bool bypass_held = stompBypass().RawState();
+        const bool preset_held = stompPreset().RawState();
+        _held_at_boot = bypass_held || preset_held;
+
+        if constexpr (profiling_enabled)
+        {
+            // Holding the preset switch alone at power-up measures the
+            // round trip latency instead of running the synth. Patch the
+            // output into the input first.
+            if (preset_held && !bypass_held)
+            {
+                _latency_probe.emplace(samples(500));
+            }
+
+            // Holding the bypass switch alone streams memory alongside the
+            // audio.
+            _memory_traffic = bypass_held && !preset_held;
+        }
+    }
+
+    // The control loop, listed in order of urgency. Run it after start.
+    auto tasks()
+    {
+        return makeScheduler<Clock>(
+            Task{"switches", 1000, [this] { updateSwitches(); }},
+            Task{"controls", 100, [this] { updateControls(); }},
+            Task{"leds", 60, [this] { updateLeds(); }},
+            Task{"storage", 10, [this] { updateStorage(); }},
+
+            // Erases and writes for saved settings, a sector or a page at
+            // a time, so the other tasks never wait long for the flash.
+            Task{"flash", 100, [this] { _hw.Settings().step(); }},
+
+            // 16 records a go keeps up with a record every block.
+            Task{"telemetry", 100, [this] {
+                if constexpr (telemetry_enabled)
+                {
+                    _telemetry_sender.step(_telemetry.ring(), _usb);
+                }
+            }},
+
+            Task{"traffic", 1000, [this] {
+                if (_memory_traffic) { _hw.StreamMemory(); }
+            }},
+
+            Task{"profile", 0.2f, [this](auto& tasks) {
+                if constexpr (profiling_enabled) { printProfile(tasks); }
+            }});
+    }
+
+    // Hands the audio its first params and starts it. callback must call
+    // processAudio.
+    void start(typename Hardware::AudioCallback callback)
+    {
+        _shared_params.publish(_params);
+        _hw.StartAudio(callback);
+        _boot_us.audio = _hw.Micros();
+    }
+
+    TCM_CODE void processAudio(const float* in, float* out, size_t size)
+    {
+        const auto time = _sample_clock.written();
+        _sample_clock.advance(static_cast<uint32_t>(size));
+
+        if (_latency_probe)
+        {
+            _latency_probe->process(in, out, size);
+            return;
+        }
+
+        // The params are only copied when the control loop has published
+        // new ones, and the knobs are only processed every KnobInterval()
+        // blocks, so short blocks don't pay for them every time.
+        bool fresh;
+        const auto& published = _shared_params.read(fresh);
+        if (fresh)
+        {
+            _audio_params = published;
+            applyKnobs(_audio_params, false);
+        }
+        if (_knob_countdown == 0)
+        {
+            applyKnobs(_audio_params, true);
+            _knob_countdown = _hw.KnobInterval();
+        }
+        _knob_countdown--;
+
+        const auto begin = CycleCounter::now();
+        _engine->process(in, out, size, _audio_params, time);
+
+        if constexpr (telemetry_enabled)
+        {
+            const auto& status = _engine->status();
+            _telemetry.record({
+                .time = static_cast<uint32_t>(time),
+                .frequency = status.frequency,
+                .envelope = status.envelope,
+                .mod_ratio = status.mod_ratio,
+                .cycles = CycleCounter::now() - begin,
+                .flags = static_cast<uint8_t>(
+                    (status.note_shift ? TelemetryRecord::note_shift : 0) |
+                    (status.gate_open ? TelemetryRecord::gate_open : 0) |
+                    (status.gate_opened ?
+                        TelemetryRecord::gate_opened : 0)),
+            });
+        }
+    }
+
+    // The control loop's state, for checks from outside
+    const EngineParams& params() const { return _params; }
+    const Settings& settings() const { return _settings; }
+    bool savePending() const { return _save_pending; }
+    const SynthEngine& engine() const { return *_engine; }
+    uint64_t sampleTime() const { return _sample_clock.load(); }
+    uint32_t telemetryDropped() { return _telemetry.ring().dropped(); }
+
+private:
+    // Sends telemetry over the hardware's USB serial port
+    struct UsbPort
+    {
+        Hardware& hw;
+
+        bool write(const uint8_t* data, size_t size)
+        {
+            return hw.WriteUsb(data, size);
+        }
+    };
+
+    auto& toggleNoise() { return _hw.toggles[0]; }
+    auto& toggleEnvelope() { return _hw.toggles[1]; }
+    auto& toggleModulate() { return _hw.toggles[2]; }
+    auto& toggleCycle() { return _hw.toggles[3]; }
+    auto& stompBypass() { return _hw.stomps[0]; }
+    auto& stompPreset() { return _hw.stomps[1]; }
+    auto& ledEnable() { return _hw.leds[0]; }
+    auto& ledPreset() { return _hw.leds[1]; }
+
+    // Holding both foot switches at power-up chooses the sample rate by the
+    // Noise and Env toggles, and saves it: Noise on for 32 kHz, Env on for
+    // 96 kHz, both off for 48 kHz. Otherwise the saved rate is used.
+    float chooseSampleRate()
+    {
+        auto& store = _hw.Settings();
+        const auto saved = store.loadSampleRate(default_sample_rate);
+        auto rate = saved;
+        if (std::ranges::find(sample_rates, rate) == sample_rates.end())
+        {
+            rate = default_sample_rate;
+        }
+
+        if (stompBypass().RawState() && stompPreset().RawState())
+        {
+            rate = toggleNoise().RawState() ? 32000 :
+                toggleEnvelope().RawState() ? 96000 :
+                48000;
+            if (rate != saved) { store.saveSampleRate(rate); }
+        }
+
+        _hw.SetSampleRate(static_cast<float>(rate));
+        return _hw.SampleRate();
+    }
+
+    uint64_t samples(float ms) const
+    {
+        return static_cast<uint64_t>(ms * _sample_rate / 1000);
+    }
+
+    // Copies the knob positions into params. The audio callback processes
+    // the knobs straight from the ADC once per block, so a turn reaches
+    // the sound within a block; the engine ramps the values in. Everything
+    // else takes the values the audio callback last processed.
+    void applyKnobs(EngineParams& params, bool process)
+    {
+        const auto knob = [this, process](int i) {
+            auto& k = _hw.knobs[i];
+            return process ? k.Process() : k.Value();
+        };
+        params.interface_state.setDryRatio(knob(0));
+        params.interface_state.setSynthRatio(knob(1));
+        params.trigger_ratio = knob(2);
+        params.interface_state.setWaveRatio(knob(3));
+        params.interface_state.setFilterRatio(knob(4));
+        params.interface_state.setResonanceRatio(knob(5));
+    }
+
+    void updateSwitches()
+    {
+        _hw.DebounceSwitches();
+        _tempo.Update(_sample_clock.load());
+
+        if (_held_at_boot)
+        {
+            // Until the debounced state lets go too
+            _held_at_boot =
+                stompBypass().RawState() || stompPreset().RawState() ||
+                stompBypass().Pressed() || stompPreset().Pressed();
+            return;
+        }
+
+        bool changed = false;
+        if (stompBypass().RisingEdge())
+        {
+            _params.enable_effect = !_params.enable_effect;
+            changed = true;
+        }
+
+        if (stompPreset().RisingEdge())
+        {
+            if (_params.apply_mod)
+            {
+                _tempo.Tap();
+                _params.mod_duration = _tempo.Interval() * 1000.0f /
+                    _sample_rate;
+            }
+            else
+            {
+                _params.use_preset = !_params.use_preset;
+            }
+            _preset_written = false;
+            changed = true;
+        }
+
+        if (changed)
+        {
+            _shared_params.publish(_params);
+        }
+    }
+
+    void updateControls()
+    {
+        applyKnobs(_params, false);
+        _params.interface_state.setNoiseEnabled(toggleNoise().Pressed());
+        _params.interface_state.setEnvelopeEnabled(
+            toggleEnvelope().Pressed());
+        _params.apply_mod = toggleModulate().Pressed();
+        _params.cycle_mod = toggleCycle().Pressed();
+
+        // Hand the audio callback the whole set at once.
+        _shared_params.publish(_params);
+    }
+
+    void updateLeds()
+    {
+        ledEnable().Set(_params.enable_effect ? 1 : 0);
+
+        if (_blink.enabled())
+        {
+            ledPreset().Set(_blink.process(_sample_clock.load()) ? 1 : 0);
+        }
+        else if (!_params.apply_mod)
+        {
+            ledPreset().Set(_params.use_preset ? 1 : 0);
+        }
+        else if (stompPreset().Pressed())
+        {
+            ledPreset().Set(1);
+        }
+        else
+        {
+            // Follows the blend from the last note: lit at the preset,
+            // dark at the knobs. The retrigger is read first, since the
+            // clock is always ahead of it.
+            const auto retrigger = _engine->lastRetrigger();
+            const auto elapsed = _sample_clock.load() - retrigger;
+            const auto period = std::max<uint64_t>(
+                samples(_params.mod_duration), 1);
+            const auto ratio = (!_params.cycle_mod && elapsed >= period / 2)
+                ? 0.5f
+                : static_cast<float>(elapsed % period) / period;
+            ledPreset().Set(std::abs(2*ratio - 1));
+        }
+    }
+
+    void updateStorage()
+    {
+        // Saved to the nearest millisecond
+        const auto mod_duration = static_cast<uint32_t>(
+            std::lround(_params.mod_duration));
+        if ((stompPreset().TimeHeldMs() > 1000) && !_preset_written &&
+            !_held_at_boot)
+        {
+            _params.preset_state = _params.interface_state;
+            _shared_params.publish(_params);
+
+            _settings.preset = _params.preset_state;
+            _settings.mod_duration = mod_duration;
+            _save_pending = true;
+
+            _preset_written = true;
+            _blink.reset(_sample_clock.load());
+        }
+
+        if ((_tempo.SinceTap() > samples(10000)) &&
+            (mod_duration != _settings.mod_duration))
+        {
+            _settings.preset = _params.preset_state;
+            _settings.mod_duration = mod_duration;
+            _save_pending = true;
+        }
+
+        if (_save_pending)
+        {
+            _save_pending = !_hw.Settings().save(_settings);
+        }
+    }
+
+    template <typename Tasks>
+    void printProfile(Tasks& tasks)
+    {
+        const auto print = [this](auto... args) { _hw.PrintLine(args...); };
+
+        if (_memory_traffic)
+        {
+            _hw.PrintLine("streaming %lu KB/s from QSPI to SDRAM",
+                static_cast<unsigned long>(
+                    Hardware::traffic_chunk * 1000 / 1024));
+        }
+
+        if (_latency_probe)
+        {
+            const auto us = [this](uint32_t samples) {
+                return static_cast<unsigned long>(
+                    (samples * 1000000ull) /
+                    static_cast<uint32_t>(_sample_rate));
+            };
+            _hw.PrintLine(
+                "round trip at %lu samples per block: "
+                "min %lu us, max %lu us, %lu clicks, %lu lost",
+                static_cast<unsigned long>(audio_block_size),
+                us(_latency_probe->min()), us(_latency_probe->max()),
+                static_cast<unsigned long>(_latency_probe->count()),
+                static_cast<unsigned long>(_latency_probe->lost()));
+        }
+
+        _engine->profiler().dump(print, SynthEngine::stage_names);
+        _engine->profiler().requestReset();
+
+        const auto recomputes = _engine->effectCache().recomputeCount();
+        _hw.PrintLine("parameter recomputes/s %lu",
+            static_cast<unsigned long>((recomputes - _last_recomputes) / 5));
+        _last_recomputes = recomputes;
+
+        _hw.PrintLine("voice cost %lu cycles/sample, room for %lu voices",
+            static_cast<unsigned long>(_engine->voiceCost()),
+            static_cast<unsigned long>(_engine->voiceCapacity()));
+
+        _hw.PrintLine("sample rate %lu Hz, %lu samples per block",
+            static_cast<unsigned long>(_sample_rate),
+            static_cast<unsigned long>(audio_block_size));
+
+        _hw.PrintLine(
+            "boot us: hardware %lu, settings %lu, engine %lu, audio %lu",
+            static_cast<unsigned long>(_boot_us.hardware),
+            static_cast<unsigned long>(_boot_us.settings),
+            static_cast<unsigned long>(_boot_us.engine),
+            static_cast<unsigned long>(_boot_us.audio));
+
+        _hw.PrintLine("flash errors %lu",
+            static_cast<unsigned long>(_hw.Settings().errors()));
+
+        if constexpr (telemetry_enabled)
+        {
+            _hw.PrintLine("telemetry records dropped %lu",
+                static_cast<unsigned long>(_telemetry.ring().dropped()));
+        }
+
+        tasks.dump(print);
+        tasks.resetStats();
+    }
+
+    Hardware& _hw;
+
+    // Microseconds from the clocks starting to the end of each boot step
+    struct
+    {
+        uint32_t hardware;
+        uint32_t settings;
+        uint32_t engine;
+        uint32_t audio;
+    } _boot_us;
+
+    // As last saved, or about to be
+    Settings _settings;
+    const float _sample_rate;
+
+    // Shared by the audio callback and the control loop. The params are
+    // published by the control loop and read once per audio block.
+    Snapshot<EngineParams> _shared_params;
+    std::optional<SynthEngine> _engine;
+    // Takes the place of the engine when latency is being measured
+    std::optional<LatencyProbe> _latency_probe;
+    // Samples since the audio started. The audio callback advances it; the
+    // control loop times taps, blinks and the modulation LED by it.
+    SampleCounter _sample_clock;
+    // Filled by the audio callback, drained by the control loop. Without
+    // telemetry the ring holds no records, so it takes no TCM.
+    std::conditional_t<telemetry_enabled,
+        TelemetryRecorder<256>, TelemetryRecorder<0>> _telemetry;
+
+    // The audio callback's own
+    EngineParams _audio_params;
+    size_t _knob_countdown = 0;
+
+    // The control loop's own
+    EngineParams _params;
+    bool _preset_written = false;
+    // Foot switches held since power-up
+    bool _held_at_boot = false;
+    // Settings changed but not yet queued for flash
+    bool _save_pending = false;
+    Blink _blink;
+    TapTempo _tempo;
+    bool _memory_traffic = false;
+    uint32_t _last_recomputes = 0;
+    UsbPort _usb{_hw};
+    TelemetrySender<telemetry_enabled ? 16 : 0> _telemetry_sender;
+};
@@ -1,8 +1,15 @@
 #pragma once
 
-#include <per/qspi.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 
 #include <util/EffectState.h>
+#include <util/FlashQueue.h>
+#include <util/PresetBank.h>
+#include <util/SlotLog.h>
 
 struct Settings
 {
@@ -10,5 +17,140 @@ struct Settings
     uint32_t mod_duration = 1000;
 };
 
-Settings loadSettings();
-void saveSettings(daisy::QSPIHandle& qspi, const Settings& settings);
+// Number of presets the bank holds. The sample rate chosen at power-up is
+// kept in the last one, which leaves the others for settings; load and
+// save use preset 0.
+constexpr size_t preset_count = 64;
+constexpr size_t user_preset_count = preset_count - 1;
+
+// Flash for the bank: two areas of four 4 KB sectors
+constexpr size_t settings_bank_size = 32 * 1024;
+
+// The single-preset slots used before the bank. Only read, as a fallback
+// for preset 0 until it's first saved to the bank.
+using LegacySettingsSlot = Slot<Settings>;
+constexpr size_t legacy_slot_count = 512;
+
+// Keeps the settings in a PresetBank on Flash, which holds
+// settings_bank_size bytes. Saving only queues the flash work, and step
+// carries it out a piece at a time.
+template <typename Flash>
+class PersistentSettings
+{
+public:
+    // legacy points to the old slots, or is null if there are none.
+    explicit PersistentSettings(Flash& flash,
+        const LegacySettingsSlot* legacy = nullptr) :
+        _queue(flash), _bank(_queue), _legacy(legacy)
+    {}
+
+    // Rebuilds the preset index from flash. Call this once before the
+    // others.
+    Settings load()
+    {
+        _bank.load();
+
+        Settings settings;
+        if (!loadPreset(0, settings) && _legacy)
+        {
+            const auto frontier = findFrontier(_legacy, legacy_slot_count);
+            const auto* latest = findLatest(_legacy, frontier);
+            if (latest) { settings = latest->value; }
+        }
+        return settings;
+    }
+
+    // Returns false if the preset has never been saved, or is past
+    // user_preset_count.
+    bool loadPreset(size_t preset, Settings& settings) const
+    {
+        if (preset >= rate_preset || !_bank.has(preset)) { return false; }
+        settings = decode(_bank.get(preset));
+        return true;
+    }
+
+    // Returns false if the queue is full.
+    bool save(const Settings& settings) { return savePreset(0, settings); }
+
+    // Returns false if the queue is full, or the preset is past
+    // user_preset_count.
+    bool savePreset(size_t preset, const Settings& settings)
+    {
+        if (preset >= rate_preset) { return false; }
+        return _bank.save(preset, encode(settings));
+    }
+
+    // Returns fallback if no rate has been saved.
+    uint32_t loadSampleRate(uint32_t fallback) const
+    {
+        if (!_bank.has(rate_preset)) { return fallback; }
+        return _bank.get(rate_preset).values[0] * 1000u;
+    }
+
+    // Saved in kHz. Returns false if the queue is full.
+    bool saveSampleRate(uint32_t rate)
+    {
+        PresetFields fields;
+        fields.values[0] = static_cast<uint16_t>(rate / 1000);
+        return _bank.save(rate_preset, fields);
+    }
+
+    // Does the next piece of queued flash work: erasing one 4 KB sector or
+    // programming one page. When nothing is queued it erases a sector
+    // ahead for the next compaction, if one is due. Returns true if it did
+    // anything.
+    bool step()
+    {
+        if (!_queue.idle())
+        {
+            _queue.step();
+            return true;
+        }
+        return _bank.maintain();
+    }
+
+    // True when no flash work is queued
+    bool idle() const { return _queue.idle(); }
+
+    // Flash work dropped after repeated failures
+    uint32_t errors() const { return _queue.errors(); }
+
+private:
+    static constexpr size_t rate_preset = user_preset_count;
+    static constexpr float ratio_scale = 4095;
+    static_assert(EffectState::ratio_count + 1 == PresetFields::count);
+
+    static PresetFields encode(const Settings& settings)
+    {
+        PresetFields fields;
+        const auto ratios = settings.preset.ratios();
+        for (size_t i = 0; i < ratios.size(); ++i)
+        {
+            const auto r = std::clamp(ratios[i], 0.0f, 1.0f);
+            fields.values[i] =
+                static_cast<uint16_t>(std::lround(r * ratio_scale));
+        }
+        fields.values[ratios.size()] =
+            static_cast<uint16_t>(std::min<uint32_t>(settings.mod_duration,
+                0xFFFF));
+        return fields;
+    }
+
+    static Settings decode(const PresetFields& fields)
+    {
+        Settings settings;
+        std::array<float, EffectState::ratio_count> ratios;
+        for (size_t i = 0; i < ratios.size(); ++i)
+        {
+            ratios[i] = fields.values[i] / ratio_scale;
+        }
+        settings.preset.setRatios(ratios);
+        settings.mod_duration = fields.values[ratios.size()];
+        return settings;
+    }
+
+    // Room for a compaction of every preset, plus a few saves
+    FlashQueue<Flash, 2048> _queue;
+    PresetBank<FlashQueue<Flash, 2048>, preset_count> _bank;
+    const LegacySettingsSlot* _legacy;
+};
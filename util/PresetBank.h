@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <util/SlotLog.h>
+
+// The values of one preset, quantized for storage. Each field has its own
+// width in bits.
+struct PresetFields
+{
+    static constexpr size_t count = 8;
+    static constexpr std::array<uint8_t, count> bits{
+        12, 12, 12, 12, 12, 12, 12, 16};
+
+    std::array<uint16_t, count> values{};
+
+    bool operator==(const PresetFields&) const = default;
+};
+
+// A bank of presets stored as a log in flash. Each save appends a record
+// holding only the fields that changed since the last save of that preset.
+//
+// The flash is split into two areas. The active one starts with a header
+// holding a generation count, followed by the records:
+//
+//   marker, preset, field mask, changed fields bit-packed, 16-bit CRC,
+//   padded with 0xFF to a multiple of 4 bytes
+//
+// When the active area is full, compaction erases the other area, writes
+// one full record for each preset there, and then writes its header,
+// which makes it the active one. If that's cut short, the old area stays
+// active. A record cut short fails its CRC and is skipped.
+//
+// Loading replays the active area into an index in RAM, so it never reads
+// more than one area however many saves have been made.
+//
+// Once the active area is half full, maintain() erases the other one a
+// sector per call, so compaction usually has nothing left to erase.
+//
+// Through a FlashQueue, the index moves on when work is queued, before it
+// reaches the flash. If the queue drops work, the next save or maintain()
+// rewrites every preset into the area that isn't valid on flash, as a
+// compaction does, so the flash catches up with the index.
+//
+// Flash provides:
+//
+//   static constexpr size_t sector_size;
+//   size_t size() const;
+//   const uint8_t* data() const; // the contents, memory-mapped
+//   bool erase(size_t offset, size_t size);
+//   bool write(size_t offset, const uint8_t* data, size_t size);
+//
+// and, if it only queues its work as FlashQueue does:
+//
+//   static constexpr bool queues_work = true;
+//   uint32_t errors() const; // times queued work was dropped
+template <typename Flash, size_t MaxPresets = 64>
+class PresetBank
+{
+public:
+    static constexpr size_t max_presets = MaxPresets;
+    static_assert(max_presets <= 255);
+
+    explicit PresetBank(Flash& flash) : _flash(flash) {}
+
+    // Rebuilds the index from flash.
+    void load()
+    {
+        _present.fill(false);
+        _active = no_area;
+        _write_pos = 0;
+        _spare_erased = 0;
+        _dropped = droppedCount();
+
+        for (size_t area = 0; area < 2; ++area)
+        {
+            const auto header = readHeader(area);
+            if (!header.valid()) { continue; }
+            if (_active == no_area ||
+                static_cast<int32_t>(header.generation - _generation) > 0)
+            {
+                _active = area;
+                _generation = header.generation;
+            }
+        }
+        if (_active == no_area) { return; }
+
+        const auto* data = _flash.data() + areaOffset(_active);
+        const auto end = areaSize();
+        auto pos = sizeof(AreaHeader);
+        while (pos + record_align <= end && !erasedFrom(data, pos, end))
+        {
+            const auto size = replay(data + pos, end - pos);
+            // On a damaged record, look for the next one.
+            pos += (size > 0) ? size : record_align;
+        }
+        _write_pos = pos;
+    }
+
+    bool has(size_t preset) const
+    {
+        return (preset < max_presets) && _present[preset];
+    }
+
+    const PresetFields& get(size_t preset) const { return _presets[preset]; }
+
+    // Appends the fields that differ from the stored preset, compacting
+    // first if the active area is full. Returns false if flash fails, or
+    // if a queue has no room, in which case nothing changes and the save
+    // can be tried again later.
+    bool save(size_t preset, const PresetFields& fields)
+    {
+        if (preset >= max_presets) { return false; }
+        if (behind() && !rebuild()) { return false; }
+
+        uint8_t mask = 0;
+        for (size_t i = 0; i < PresetFields::count; ++i)
+        {
+            if (!_present[preset] ||
+                fields.values[i] != _presets[preset].values[i])
+            {
+                mask |= 1 << i;
+            }
+        }
+        if (mask == 0) { return true; }
+
+        if (_active == no_area && !startArea(0)) { return false; }
+
+        const auto size = recordSize(mask);
+        if (_write_pos + size > areaSize() && !compact()) { return false; }
+
+        std::array<uint8_t, max_record_size> record;
+        encode(record.data(), preset, mask, fields);
+        const auto offset = areaOffset(_active) + _write_pos;
+        if (!_flash.write(offset, record.data(), size))
+        {
+            if constexpr (!queues_work)
+            {
+                // Part of the record may have been programmed, or none of
+                // it, leaving a gap that would end the log when it's
+                // loaded. Either way, the next save compacts.
+                _write_pos = areaSize();
+            }
+            return false;
+        }
+        _write_pos += size;
+
+        _presets[preset] = fields;
+        _present[preset] = true;
+        return true;
+    }
+
+    // Erases the next sector of the area compaction will write to, if the
+    // active area is at least half full. A sector that's already erased
+    // is only checked. Returns true if there was a sector to do.
+    bool maintain()
+    {
+        if (behind())
+        {
+            rebuild();
+            return true;
+        }
+        if (_active == no_area || _write_pos < areaSize() / 2 ||
+            _spare_erased == sectorCount())
+        {
+            return false;
+        }
+
+        const auto offset = areaOffset(1 - _active) +
+            (_spare_erased * Flash::sector_size);
+        const auto* sector = _flash.data() + offset;
+        const bool erased = std::all_of(sector,
+            sector + Flash::sector_size, [](uint8_t b) { return b == 0xFF; });
+        if (erased || _flash.erase(offset, Flash::sector_size))
+        {
+            _spare_erased++;
+        }
+        return true;
+    }
+
+    // Bytes of the active area in use, and its size
+    size_t logSize() const { return _write_pos; }
+    size_t areaSize() const { return sectorCount() * Flash::sector_size; }
+
+    // Size of a record holding the fields in mask
+    static constexpr size_t recordSize(uint8_t mask)
+    {
+        const auto size = record_overhead + fieldBytes(mask);
+        return (size + record_align - 1) / record_align * record_align;
+    }
+
+private:
+    static constexpr uint32_t area_magic = 0x50524553;
+    static constexpr uint8_t record_marker = 0xA5;
+    static constexpr size_t record_align = 4;
+    // Marker, preset and mask before the fields, and the CRC after
+    static constexpr size_t record_overhead = 5;
+    static constexpr uint8_t all_fields = (1 << PresetFields::count) - 1;
+    static constexpr size_t max_record_size = recordSize(all_fields);
+    static constexpr size_t no_area = 2;
+    static constexpr bool queues_work =
+        requires { requires Flash::queues_work; };
+
+    struct AreaHeader
+    {
+        uint32_t magic;
+        uint32_t generation;
+        uint32_t check;
+        uint32_t reserved;
+
+        uint32_t calculateCheck() const
+        {
+            return Crc32c::calculate(
+                reinterpret_cast<const uint8_t*>(this), 8);
+        }
+
+        bool valid() const
+        {
+            return magic == area_magic && check == calculateCheck();
+        }
+    };
+
+    static constexpr size_t fieldBytes(uint8_t mask)
+    {
+        size_t bits = 0;
+        for (size_t i = 0; i < PresetFields::count; ++i)
+        {
+            if (mask & (1 << i)) { bits += PresetFields::bits[i]; }
+        }
+        return (bits + 7) / 8;
+    }
+
+    static uint16_t recordCheck(const uint8_t* record, size_t size)
+    {
+        return static_cast<uint16_t>(Crc32c::calculate(record, size));
+    }
+
+    // Writes a record into out, which must hold max_record_size bytes.
+    static void encode(uint8_t* out, size_t preset, uint8_t mask,
+        const PresetFields& fields)
+    {
+        std::fill_n(out, max_record_size, 0xFF);
+        out[0] = record_marker;
+        out[1] = static_cast<uint8_t>(preset);
+        out[2] = mask;
+
+        auto* p = out + 3;
+        uint32_t acc = 0;
+        int acc_bits = 0;
+        for (size_t i = 0; i < PresetFields::count; ++i)
+        {
+            if (!(mask & (1 << i))) { continue; }
+            acc |= static_cast<uint32_t>(fields.values[i]) << acc_bits;
+            acc_bits += PresetFields::bits[i];
+            for (; acc_bits >= 8; acc_bits -= 8, acc >>= 8)
+            {
+                *p++ = static_cast<uint8_t>(acc);
+            }
+        }
+        if (acc_bits > 0) { *p++ = static_cast<uint8_t>(acc); }
+
+        const auto check = recordCheck(out, p - out);
+        p[0] = static_cast<uint8_t>(check);
+        p[1] = static_cast<uint8_t>(check >> 8);
+    }
+
+    // Applies the record at data to the index. Returns its size, or 0 if
+    // it isn't a whole, valid record.
+    size_t replay(const uint8_t* data, size_t available)
+    {
+        if (available < record_overhead || data[0] != record_marker)
+        {
+            return 0;
+        }
+        const auto preset = data[1];
+        const auto mask = data[2];
+        const auto size = recordSize(mask);
+        if (preset >= max_presets || size > available) { return 0; }
+
+        const auto checked = 3 + fieldBytes(mask);
+        const auto stored = static_cast<uint16_t>(
+            data[checked] | (data[checked + 1] << 8));
+        if (stored != recordCheck(data, checked)) { return 0; }
+
+        auto& fields = _presets[preset];
+        const auto* p = data + 3;
+        uint32_t acc = 0;
+        int acc_bits = 0;
+        for (size_t i = 0; i < PresetFields::count; ++i)
+        {
+            if (!(mask & (1 << i))) { continue; }
+            const auto width = PresetFields::bits[i];
+            for (; acc_bits < width; acc_bits += 8)
+            {
+                acc |= static_cast<uint32_t>(*p++) << acc_bits;
+            }
+            const auto field_mask = (uint32_t(1) << width) - 1;
+            fields.values[i] = static_cast<uint16_t>(acc & field_mask);
+            acc >>= width;
+            acc_bits -= width;
+        }
+        _present[preset] = true;
+        return size;
+    }
+
+    // True if there's no record at pos: the next max_record_size bytes are
+    // all erased. Checking the whole span keeps a stray 0xFF inside a
+    // damaged record from being taken for the end of the log.
+    static bool erasedFrom(const uint8_t* data, size_t pos, size_t end)
+    {
+        const auto last = std::min(pos + max_record_size, end);
+        return std::all_of(data + pos, data + last,
+            [](uint8_t b) { return b == 0xFF; });
+    }
+
+    size_t sectorCount() const
+    {
+        return (_flash.size() / 2) / Flash::sector_size;
+    }
+
+    size_t areaOffset(size_t area) const { return area * areaSize(); }
+
+    AreaHeader readHeader(size_t area) const
+    {
+        AreaHeader header;
+        std::copy_n(_flash.data() + areaOffset(area), sizeof(header),
+            reinterpret_cast<uint8_t*>(&header));
+        return header;
+    }
+
+    bool writeHeader(size_t area, uint32_t generation)
+    {
+        AreaHeader header{area_magic, generation, 0, 0xFFFFFFFF};
+        header.check = header.calculateCheck();
+        return _flash.write(areaOffset(area),
+            reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    }
+
+    uint32_t droppedCount() const
+    {
+        if constexpr (queues_work) { return _flash.errors(); }
+        return 0;
+    }
+
+    // True if queued work was dropped since the flash last matched the
+    // index
+    bool behind() const { return droppedCount() != _dropped; }
+
+    // Compacts into whichever area isn't valid on flash, erasing all of
+    // it, so the one that is stays untouched until the rewrite is whole.
+    bool rebuild()
+    {
+        const auto dropped = droppedCount();
+        size_t valid = no_area;
+        for (size_t area = 0; area < 2; ++area)
+        {
+            const auto header = readHeader(area);
+            if (!header.valid()) { continue; }
+            if (valid == no_area ||
+                static_cast<int32_t>(header.generation - _generation) > 0)
+            {
+                valid = area;
+                _generation = header.generation;
+            }
+        }
+        _active = (valid == no_area) ? 1 : valid;
+        _spare_erased = 0;
+        if (!compact()) { return false; }
+        _dropped = dropped;
+        return true;
+    }
+
+    // Makes an empty area the active one.
+    bool startArea(size_t area)
+    {
+        if (!_flash.erase(areaOffset(area), areaSize())) { return false; }
+        if (!writeHeader(area, _generation + 1)) { return false; }
+        _active = area;
+        _generation++;
+        _write_pos = sizeof(AreaHeader);
+        return true;
+    }
+
+    // Rewrites every preset as a full record into the other area, erasing
+    // whatever maintain() hasn't.
+    bool compact()
+    {
+        const auto target = 1 - _active;
+        const auto erased = _spare_erased * Flash::sector_size;
+        if (erased < areaSize() &&
+            !_flash.erase(areaOffset(target) + erased, areaSize() - erased))
+        {
+            return false;
+        }
+        _spare_erased = sectorCount();
+
+        auto pos = sizeof(AreaHeader);
+        std::array<uint8_t, max_record_size> record;
+        for (size_t preset = 0; preset < max_presets; ++preset)
+        {
+            if (!_present[preset]) { continue; }
+            encode(record.data(), preset, all_fields, _presets[preset]);
+            if (!_flash.write(areaOffset(target) + pos, record.data(),
+                    max_record_size))
+            {
+                _spare_erased = 0;
+                return false;
+            }
+            pos += max_record_size;
+        }
+
+        // The header goes last, so the new area only counts once it's
+        // complete.
+        if (!writeHeader(target, _generation + 1))
+        {
+            _spare_erased = 0;
+            return false;
+        }
+        _active = target;
+        _generation++;
+        _write_pos = pos;
+        _spare_erased = 0;
+        return true;
+    }
+
+    Flash& _flash;
+    std::array<PresetFields, max_presets> _presets{};
+    std::array<bool, max_presets> _present{};
+    size_t _active = no_area;
+    uint32_t _generation = 0;
+    size_t _write_pos = 0;
+    // Sectors at the start of the other area known to be erased
+    size_t _spare_erased = 0;
+    // The queue's drop count when the flash last matched the index
+    uint32_t _dropped = 0;
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(__arm__)
+#include <stm32h7xx.h>
+#else
+#include <chrono>
+#endif
+
+#if defined(TERRARIUM_PROFILE)
+inline constexpr bool profiling_enabled = true;
+#else
+inline constexpr bool profiling_enabled = false;
+#endif
+
+// Free-running tick counter for timing the audio path. On the Daisy this is
+// the Cortex-M7 DWT cycle counter. Host builds count nanoseconds.
+class CycleCounter
+{
+public:
+    static void init()
+    {
+#if defined(__arm__)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->LAR = 0xC5ACCE55;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    }
+
+    static uint32_t now()
+    {
+#if defined(__arm__)
+        return DWT->CYCCNT;
+#else
+        using namespace std::chrono;
+        const auto t = steady_clock::now().time_since_epoch();
+        return static_cast<uint32_t>(duration_cast<nanoseconds>(t).count());
+#endif
+    }
+
+    // Ticks per second
+    static uint32_t frequency()
+    {
+#if defined(__arm__)
+        return SystemCoreClock;
+#else
+        return 1'000'000'000;
+#endif
+    }
+};
+
+// Running min/mean/max of tick counts, plus a log-scale histogram for
+// percentiles. Each power of two is split into four bins, so percentiles
+// are accurate to within 25%.
+class TimingStats
+{
+public:
+    void add(uint32_t ticks)
+    {
+        _min = std::min(_min, ticks);
+        _max = std::max(_max, ticks);
+        _sum += ticks;
+        _count++;
+        _bins[binIndex(ticks)]++;
+    }
+
+    void reset()
+    {
+        *this = TimingStats();
+    }
+
+    uint32_t count() const { return _count; }
+    uint32_t min() const { return _count ? _min : 0; }
+    uint32_t max() const { return _max; }
+    uint32_t mean() const
+    {
+        return _count ? static_cast<uint32_t>(_sum / _count) : 0;
+    }
+
+    // 0 <= p <= 1
+    // Returns the upper bound of the bin holding the given percentile.
+    uint32_t percentile(float p) const
+    {
+        const auto target = static_cast<uint64_t>(p * _count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _bins.size(); ++i)
+        {
+            seen += _bins[i];
+            if (seen > target)
+            {
+                return std::min(binUpper(i), _max);
+            }
+        }
+        return _max;
+    }
+
+private:
+    static constexpr int sub_bins = 4;
+    static constexpr int bin_count = 32 * sub_bins;
+
+    static size_t binIndex(uint32_t ticks)
+    {
+        if (ticks < sub_bins) { return ticks; }
+        const auto msb = std::bit_width(ticks) - 1;
+        const auto sub = (ticks >> (msb - 2)) & (sub_bins - 1);
+        return ((msb - 1) * sub_bins) + sub;
+    }
+
+    static uint32_t binUpper(size_t index)
+    {
+        if (index < sub_bins) { return static_cast<uint32_t>(index); }
+        const auto msb = static_cast<int>(index / sub_bins) + 1;
+        const auto sub = index % sub_bins;
+        const auto upper = static_cast<uint64_t>(sub_bins + sub + 1)
+            << (msb - 2);
+        return static_cast<uint32_t>(std::min<uint64_t>(
+            upper - 1, std::numeric_limits<uint32_t>::max()));
+    }
+
+    uint32_t _min = std::numeric_limits<uint32_t>::max();
+    uint32_t _max = 0;
+    uint64_t _sum = 0;
+    uint32_t _count = 0;
+    std::array<uint32_t, bin_count> _bins{};
+};
+
+// Per-block timing of the stages of an audio callback. Stage is an enum
+// whose last member is count. Stages may be lapped many times per block;
+// their times are summed and recorded once per block.
+//
+// Everything compiles away unless TERRARIUM_PROFILE is defined.
+template <typename Stage>
+class Profiler
+{
+public:
+    static constexpr auto stage_count = static_cast<size_t>(Stage::count);
+
+    void beginBlock()
+    {
+        if constexpr (profiling_enabled)
+        {
+            if (_reset_requested)
+            {
+                for (auto& s : _stages) { s.reset(); }
+                _total.reset();
+                _overruns = 0;
+                _reset_requested = false;
+            }
+            _block_begin = CycleCounter::now();
+            _lap_begin = _block_begin;
+            _block_ticks.fill(0);
+        }
+    }
+
+    // Charges the time since the previous lap to the given stage.
+    void lap(Stage stage)
+    {
+        if constexpr (profiling_enabled)
+        {
+            const auto now = CycleCounter::now();
+            _block_ticks[static_cast<size_t>(stage)] += now - _lap_begin;
+            _lap_begin = now;
+        }
+    }
+
+    // budget is the number of ticks available for the block.
+    void endBlock(uint32_t budget)
+    {
+        if constexpr (profiling_enabled)
+        {
+            for (size_t i = 0; i < stage_count; ++i)
+            {
+                _stages[i].add(_block_ticks[i]);
+            }
+            const auto total = CycleCounter::now() - _block_begin;
+            _total.add(total);
+            _budget = budget;
+            if (total > budget) { _overruns++; }
+        }
+    }
+
+    // Clears the statistics at the start of the next block.
+    void requestReset() { _reset_requested = true; }
+
+    const TimingStats& stage(Stage s) const
+    {
+        return _stages[static_cast<size_t>(s)];
+    }
+
+    const TimingStats& total() const { return _total; }
+    uint32_t overruns() const { return _overruns; }
+
+    // Writes one line per stage through print, which is called like
+    // printf without a trailing newline.
+    template <typename Print>
+    void dump(
+        Print&& print,
+        const std::array<const char*, stage_count>& names) const
+    {
+        print("%-10s %8s %8s %8s %8s %8s",
+            "stage", "min", "mean", "p50", "p99", "max");
+        const auto line = [&](const char* name, const TimingStats& s) {
+            print("%-10s %8lu %8lu %8lu %8lu %8lu", name,
+                static_cast<unsigned long>(s.min()),
+                static_cast<unsigned long>(s.mean()),
+                static_cast<unsigned long>(s.percentile(0.5f)),
+                static_cast<unsigned long>(s.percentile(0.99f)),
+                static_cast<unsigned long>(s.max()));
+        };
+        for (size_t i = 0; i < stage_count; ++i)
+        {
+            line(names[i], _stages[i]);
+        }
+        line("total", _total);
+        // Share of the block's time, in percent
+        const auto load = [&](uint32_t ticks) {
+            return static_cast<unsigned long>(
+                _budget ? (static_cast<uint64_t>(ticks) * 100) / _budget : 0);
+        };
+        print("blocks %lu, overruns %lu, load mean %lu%%, max %lu%%",
+            static_cast<unsigned long>(_total.count()),
+            static_cast<unsigned long>(_overruns),
+            load(_total.mean()),
+            load(_total.max()));
+    }
+
+private:
+    std::array<TimingStats, stage_count> _stages;
+    TimingStats _total;
+    uint32_t _overruns = 0;
+    uint32_t _budget = 0;
+    volatile bool _reset_requested = false;
+
+    uint32_t _block_begin = 0;
+    uint32_t _lap_begin = 0;
+    std::array<uint32_t, stage_count> _block_ticks{};
+};
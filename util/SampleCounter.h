@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// A 64-bit count of samples, written by the audio callback and read from
+// the control loop without locks. It serves as the clock for everything
+// timed in samples, and for times stamped on that clock.
+//
+// The halves are guarded by a sequence count, odd while a write is under
+// way. A read that overlaps a write tries again. Unlike Snapshot's case,
+// that never spins for long: the writer is the audio interrupt, which
+// always finishes before the control loop it interrupted carries on.
+class SampleCounter
+{
+public:
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    // Writer side
+    void store(uint64_t value)
+    {
+        _value = value;
+        const auto sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _low.store(static_cast<uint32_t>(value), std::memory_order_relaxed);
+        _high.store(
+            static_cast<uint32_t>(value >> 32), std::memory_order_relaxed);
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void advance(uint32_t samples) { store(_value + samples); }
+
+    // The last value stored, for the writer only
+    uint64_t written() const { return _value; }
+
+    // Reader side
+    uint64_t load() const
+    {
+        uint32_t before;
+        uint32_t after;
+        uint32_t low;
+        uint32_t high;
+        do
+        {
+            before = _sequence.load(std::memory_order_acquire);
+            low = _low.load(std::memory_order_relaxed);
+            high = _high.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _sequence.load(std::memory_order_relaxed);
+        } while ((before != after) || (before & 1));
+        return (static_cast<uint64_t>(high) << 32) | low;
+    }
+
+private:
+    uint64_t _value = 0;
+    std::atomic<uint32_t> _sequence{0};
+    std::atomic<uint32_t> _low{0};
+    std::atomic<uint32_t> _high{0};
+};
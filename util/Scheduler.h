@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <util/Profiler.h>
+
+// A periodic task for Scheduler. run is called frequency times a second.
+template <typename F>
+struct Task
+{
+    const char* name;
+    float frequency;
+    F run;
+};
+
+template <typename F>
+Task(const char*, float, F) -> Task<F>;
+
+// Runs periodic tasks at their own rates from the main loop, and sleeps
+// between them.
+//
+// Tasks are cooperative: each runs to completion, so a task that takes
+// long delays the others. When several are due, the one listed first runs
+// first, and the list is checked again from the top after every task, so
+// put the tasks that need the quickest response first.
+//
+// The task callables are stored by value and called directly, without
+// std::function. A task may take the Scheduler by reference, to report on
+// the others. Clock supplies the time:
+//
+//   static uint32_t now();       // ticks, wrapping
+//   static uint32_t frequency(); // ticks per second
+//   static void idle();          // wait for something to happen
+template <typename Clock, typename... F>
+class Scheduler
+{
+public:
+    static constexpr size_t task_count = sizeof...(F);
+
+    explicit Scheduler(Task<F>... tasks) :
+        _tasks(std::move(tasks.run)...)
+    {
+        const auto now = Clock::now();
+        size_t i = 0;
+        (initState(_states[i++], tasks.name, tasks.frequency, now), ...);
+    }
+
+    // Runs the tasks forever.
+    [[noreturn]] void run()
+    {
+        while (true)
+        {
+            const auto next = poll();
+            while (static_cast<int32_t>(next - Clock::now()) > 0)
+            {
+                Clock::idle();
+            }
+        }
+    }
+
+    // Runs the first task that is due, if any. Returns the time the next
+    // task is due.
+    uint32_t poll()
+    {
+        runFirstDue(std::index_sequence_for<F...>{});
+
+        auto next = _states[0].next;
+        const auto now = Clock::now();
+        for (const auto& s : _states)
+        {
+            if (static_cast<int32_t>(s.next - now) <
+                static_cast<int32_t>(next - now))
+            {
+                next = s.next;
+            }
+        }
+        return next;
+    }
+
+    // Clears the timing statistics.
+    void resetStats()
+    {
+        for (auto& s : _states)
+        {
+            s.jitter.reset();
+            s.run_time.reset();
+            s.missed = 0;
+        }
+    }
+
+    // How late task i started, and how long it ran, in ticks
+    const TimingStats& lateness(size_t i) const { return _states[i].jitter; }
+    const TimingStats& runTime(size_t i) const { return _states[i].run_time; }
+
+    // Prints how late each task started and how long it ran, in
+    // microseconds, with the number of periods it missed entirely.
+    template <typename Print>
+    void dump(Print&& print) const
+    {
+        const auto us = [](uint32_t ticks) {
+            return static_cast<unsigned long>(
+                (static_cast<uint64_t>(ticks) * 1000000) /
+                Clock::frequency());
+        };
+
+        print("task         late: mean   p99   max   run: mean   p99   max"
+            "  missed");
+        for (const auto& s : _states)
+        {
+            print("%-12s %10lu %5lu %5lu %10lu %5lu %5lu %7lu",
+                s.name,
+                us(s.jitter.mean()),
+                us(s.jitter.percentile(0.99f)),
+                us(s.jitter.max()),
+                us(s.run_time.mean()),
+                us(s.run_time.percentile(0.99f)),
+                us(s.run_time.max()),
+                static_cast<unsigned long>(s.missed));
+        }
+    }
+
+private:
+    struct State
+    {
+        const char* name = "";
+        uint32_t period = 0;
+        uint32_t next = 0;
+        TimingStats jitter;
+        TimingStats run_time;
+        uint32_t missed = 0;
+    };
+
+    static void initState(
+        State& s, const char* name, float frequency, uint32_t now)
+    {
+        s.name = name;
+        s.period = static_cast<uint32_t>(Clock::frequency() / frequency);
+        s.next = now;
+    }
+
+    template <size_t... I>
+    void runFirstDue(std::index_sequence<I...>)
+    {
+        (runIfDue<I>() || ...);
+    }
+
+    template <size_t I>
+    bool runIfDue()
+    {
+        auto& s = _states[I];
+        const auto begin = Clock::now();
+        const auto late = begin - s.next;
+        if (static_cast<int32_t>(late) < 0) { return false; }
+
+        auto& task = std::get<I>(_tasks);
+        if constexpr (std::is_invocable_v<decltype(task), Scheduler&>)
+        {
+            task(*this);
+        }
+        else
+        {
+            task();
+        }
+        const auto end = Clock::now();
+        s.jitter.add(late);
+        s.run_time.add(end - begin);
+
+        // Keep to the original grid, but skip periods that have already
+        // gone by rather than running the task back to back.
+        s.next += s.period;
+        const auto behind = end - s.next;
+        if (static_cast<int32_t>(behind) >= static_cast<int32_t>(s.period))
+        {
+            const auto skipped = behind / s.period;
+            s.missed += skipped;
+            s.next += skipped * s.period;
+        }
+        return true;
+    }
+
+    std::tuple<F...> _tasks;
+    std::array<State, task_count> _states;
+};
+
+template <typename Clock, typename... F>
+Scheduler<Clock, F...> makeScheduler(Task<F>... tasks)
+{
+    return Scheduler<Clock, F...>(std::move(tasks)...);
+}
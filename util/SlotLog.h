@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__arm__)
+#include <stm32h7xx.h>
+#endif
+
+constexpr uint32_t crc32c_poly = 0x82f63b78;
+
+using Crc32cTables = std::array<std::array<uint32_t, 256>, 4>;
+
+// tables[n][b] is the CRC-32C of byte b followed by n zero bytes.
+constexpr Crc32cTables makeCrc32cTables()
+{
+    Crc32cTables t{};
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (crc32c_poly & (0 - (crc & 1)));
+        }
+        t[0][b] = crc;
+    }
+    for (size_t n = 1; n < t.size(); ++n)
+    {
+        for (size_t b = 0; b < 256; ++b)
+        {
+            const auto prev = t[n - 1][b];
+            t[n][b] = (prev >> 8) ^ t[0][prev & 0xFF];
+        }
+    }
+    return t;
+}
+
+// CRC-32C (Castagnoli), reflected, as used for the settings slots.
+//
+// The pedal runs it on the STM32H7 CRC unit, set up for this polynomial.
+// Host builds use a slice-by-4 table instead.
+class Crc32c
+{
+public:
+#if defined(__arm__)
+    static uint32_t calculate(const uint8_t* data, size_t length)
+    {
+        RCC->AHB4ENR |= RCC_AHB4ENR_CRCEN;
+        (void)RCC->AHB4ENR; // let the clock enable take effect
+
+        CRC->POL = 0x1EDC6F41;
+        CRC->INIT = 0xFFFFFFFF;
+        // 32-bit polynomial, input reflected per byte, output reflected
+        CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+
+        auto* dr8 = reinterpret_cast<volatile uint8_t*>(&CRC->DR);
+        while (length--)
+        {
+            *dr8 = *data++;
+        }
+        return ~CRC->DR;
+    }
+#else
+    static uint32_t calculate(const uint8_t* data, size_t length)
+    {
+        static constexpr auto tables = makeCrc32cTables();
+        uint32_t crc = ~0u;
+        for (; length >= 4; length -= 4, data += 4)
+        {
+            crc ^= static_cast<uint32_t>(data[0]) |
+                (static_cast<uint32_t>(data[1]) << 8) |
+                (static_cast<uint32_t>(data[2]) << 16) |
+                (static_cast<uint32_t>(data[3]) << 24);
+            crc = tables[3][crc & 0xFF] ^
+                tables[2][(crc >> 8) & 0xFF] ^
+                tables[1][(crc >> 16) & 0xFF] ^
+                tables[0][crc >> 24];
+        }
+        while (length--)
+        {
+            crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xFF];
+        }
+        return ~crc;
+    }
+#endif
+
+    // Bit at a time, as the reference for the faster versions
+    static uint32_t reference(const uint8_t* data, size_t length)
+    {
+        uint32_t crc = ~0u;
+        while (length--)
+        {
+            crc ^= *data++;
+            for (int i = 0; i < 8; i++)
+            {
+                crc = (crc >> 1) ^ (crc32c_poly & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+};
+
+// A value stored in flash with a header and a check value. Slots are
+// written one after another into erased flash, so the slots in use are
+// always a run at the start, followed by empty ones.
+template <typename T>
+struct Slot
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    static constexpr uint32_t empty = 0xFFFFFFFF;
+    static constexpr uint32_t flag = 0x4AC0FFEE;
+
+    uint32_t header;
+    T value;
+    uint32_t check;
+
+    static Slot make(const T& value)
+    {
+        Slot slot{
+            .header = flag,
+            .value = value,
+            .check = 0
+        };
+        slot.check = slot.calculateCheck();
+        return slot;
+    }
+
+    uint32_t calculateCheck() const
+    {
+        const auto data = reinterpret_cast<const uint8_t*>(this);
+        const auto size = sizeof(*this) - sizeof(check);
+        return Crc32c::calculate(data, size);
+    }
+
+    bool valid() const
+    {
+        return (header == flag) && (check == calculateCheck());
+    }
+
+    // True if every byte is still erased
+    bool erased() const
+    {
+        const auto data = reinterpret_cast<const uint8_t*>(this);
+        for (size_t i = 0; i < sizeof(*this); ++i)
+        {
+            if (data[i] != 0xFF) { return false; }
+        }
+        return true;
+    }
+};
+
+// Index of the first unused slot, or count if all are used. Binary search
+// on the header, since the used slots come first. If that slot isn't fully
+// erased, a write to it was cut short, so it's skipped.
+template <typename T>
+size_t findFrontier(const Slot<T>* slots, size_t count)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
+    {
+        const auto mid = low + ((high - low) / 2);
+        if (slots[mid].header == Slot<T>::empty)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    while ((low < count) && !slots[low].erased())
+    {
+        ++low;
+    }
+    return low;
+}
+
+// The newest valid slot before frontier, or nullptr if there's none.
+// Slots whose write was cut short fail their check and are passed over.
+template <typename T>
+const Slot<T>* findLatest(const Slot<T>* slots, size_t frontier)
+{
+    for (auto i = frontier; i--;)
+    {
+        if (slots[i].valid()) { return &slots[i]; }
+    }
+    return nullptr;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands complete copies of a value from one writer to one reader without
+// locks, so the reader never sees a mix of two updates.
+//
+// This is a triple buffer. The writer fills a back buffer and swaps it
+// with a middle one; the reader swaps the middle one with its front buffer
+// when something new is there. Neither side ever waits for the other,
+// which matters on a single core where the audio interrupt preempts the
+// control loop: a seqlock reader would spin there until the writer it
+// interrupted finished, which it never does.
+template <typename T>
+class Snapshot
+{
+public:
+    static_assert(std::atomic<uint8_t>::is_always_lock_free);
+
+    // Writer side: copies value into the back buffer and makes it the
+    // latest snapshot.
+    void publish(const T& value)
+    {
+        _buffers[_back] = value;
+        const auto old = _middle.exchange(
+            _back | fresh_bit, std::memory_order_acq_rel);
+        _back = old & index_mask;
+    }
+
+    // Reader side: returns the latest published value. It stays valid and
+    // unchanged until the next call.
+    const T& read()
+    {
+        bool fresh;
+        return read(fresh);
+    }
+
+    // As read(), also telling whether the value is new since the last call.
+    const T& read(bool& fresh)
+    {
+        fresh = _middle.load(std::memory_order_relaxed) & fresh_bit;
+        if (fresh)
+        {
+            _front = _middle.exchange(_front, std::memory_order_acq_rel) &
+                index_mask;
+        }
+        return _buffers[_front];
+    }
+
+private:
+    static constexpr uint8_t index_mask = 0x3;
+    static constexpr uint8_t fresh_bit = 0x4;
+
+    std::array<T, 3> _buffers{};
+    uint8_t _back = 0;
+    std::atomic<uint8_t> _middle{1};
+    uint8_t _front = 2;
+};
@@ -1,11 +1,49 @@
 #pragma once
 
-#include <cassert>
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <numbers>
 
+#include <gcem.hpp>
 #include <q/detail/fast_math.hpp>
 #include <q/support/frequency.hpp>
 
+// Table of the SvFilter tuning coefficient k = tan(pi * f), where f is the
+// corner frequency as a fraction of the sample rate. The table is built at
+// compile time; lookups interpolate linearly, and are within 0.1% of tan
+// all the way up to max_corner.
+class SvFilterTuning
+{
+public:
+    // Corners are clamped to this, since k goes to infinity at Nyquist.
+    static constexpr float max_corner = 0.49;
+
+    static float k(float f)
+    {
+        const auto x = std::clamp(f, 0.0f, max_corner) * scale;
+        const auto i = static_cast<size_t>(x);
+        const auto t = x - i;
+        return _table[i] + (t * (_table[i + 1] - _table[i]));
+    }
+
+private:
+    static constexpr size_t size = 1024;
+    static constexpr float scale = size / max_corner;
+
+    // One extra entry so f == max_corner can interpolate.
+    static constexpr auto _table = [] {
+        std::array<float, size + 2> table{};
+        for (size_t i = 0; i < table.size(); ++i)
+        {
+            const auto f = static_cast<double>(max_corner) * i / size;
+            table[i] = static_cast<float>(
+                gcem::tan(std::numbers::pi * std::min(f, 0.4999)));
+        }
+        return table;
+    }();
+};
+
 // Algorithm source: https://arxiv.org/pdf/2111.05592
 // "Improving the Chamberlin Digital State Variable Filter"
 // by Victor Lazzarini and Joseph Timoney
@@ -19,17 +57,31 @@ public:
         config(corner, sample_rate, q);
     }
 
+    // Corners above SvFilterTuning::max_corner times the sample rate are
+    // clamped to it.
     void config(cycfi::q::frequency corner, float sample_rate, float q=0.707)
     {
         constexpr auto pi = std::numbers::pi_v<float>;
-        const auto f = cycfi::q::as_float(corner) / sample_rate;
-        assert(f <= 0.5); // fastertan expects input in [-pi/2, pi/2]
-        const auto k = fastertan(pi * f);
+        const auto f = std::min(
+            cycfi::q::as_float(corner) / sample_rate,
+            SvFilterTuning::max_corner);
+        _q_inv = 1 / q;
+        setK(fastertan(pi * f)); // fastertan expects input in [-pi/2, pi/2]
+    }
 
-        _k = k;
+    // Sets the resonance used by tune().
+    void setResonance(float q)
+    {
         _q_inv = 1 / q;
-        _c1 = _q_inv + k;
-        _c2 = 1 / (1 + (k * _q_inv) + (k * k));
+        setK(_k);
+    }
+
+    // Moves the corner to f, a fraction of the sample rate, keeping the
+    // resonance. Uses SvFilterTuning instead of tan, so it's cheap enough to
+    // call every sample.
+    void tune(float f)
+    {
+        setK(SvFilterTuning::k(f));
     }
 
     void update(float sample)
@@ -67,6 +119,13 @@ public:
     }
 
 private:
+    void setK(float k)
+    {
+        _k = k;
+        _c1 = _q_inv + k;
+        _c2 = 1 / (1 + (k * _q_inv) + (k * k));
+    }
+
     float _k = 0;
     float _q_inv = 0;
     float _c1 = 0;
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include <util/SvFilter.h>
+
+// Up to four SvFilter stages in series, for 12, 24, 36 or 48 dB/octave
+// slopes. Only the last stage is resonant; the others are Butterworth.
+//
+// State is kept as one array per variable with a lane per stage, and the
+// stages are skewed by one sample each: every sample, lane n filters what
+// lane n-1 produced on the previous sample. That makes the lanes
+// independent, so they update with the same arithmetic and vectorize where
+// the target has float SIMD. The stage count is a template parameter, so
+// only the stages in use run, which matters on the M7 with none. The cost
+// is a delay of one sample per extra stage.
+class SvCascade
+{
+public:
+    static constexpr size_t max_stages = 4;
+
+    // 1 <= stages <= max_stages
+    void setStages(size_t stages)
+    {
+        const auto last = std::clamp<size_t>(stages, 1, max_stages) - 1;
+        if (last == _last) { return; }
+        // Stages that weren't running start from rest.
+        for (size_t i = _last + 1; i <= last; ++i)
+        {
+            _s1[i] = _s2[i] = _out[i] = 0;
+        }
+        _last = last;
+        tuneK(_k);
+    }
+
+    size_t stages() const { return _last + 1; }
+
+    void setResonance(float q)
+    {
+        _q_inv_last = 1 / q;
+        tuneK(_k);
+    }
+
+    // f is the corner as a fraction of the sample rate. Does nothing if
+    // it's unchanged.
+    void tune(float f)
+    {
+        if (f == _f) { return; }
+        _f = f;
+        tuneK(SvFilterTuning::k(f));
+    }
+
+    void reset()
+    {
+        _s1.fill(0);
+        _s2.fill(0);
+        _out.fill(0);
+    }
+
+    // Stages must match stages().
+    template <bool HighPass, size_t Stages>
+    float process(float sample)
+    {
+        static_assert(Stages >= 1 && Stages <= max_stages);
+        constexpr auto stages = Stages;
+        std::array<float, max_stages> in;
+        in[0] = sample;
+        for (size_t i = 1; i < stages; ++i)
+        {
+            in[i] = _out[i - 1];
+        }
+
+        const auto k = _k;
+        for (size_t i = 0; i < stages; ++i)
+        {
+            const auto hp = (in[i] - (_c1[i] * _s1[i]) - _s2[i]) * _c2[i];
+            const auto bp = (k * hp) + _s1[i];
+            _s1[i] = (k * hp) + bp;
+            const auto lp = (k * bp) + _s2[i];
+            _s2[i] = (k * bp) + lp;
+            _out[i] = HighPass ? hp : lp;
+        }
+        return _out[stages - 1];
+    }
+
+private:
+    static constexpr float butterworth_q_inv = 1 / 0.707f;
+
+    void tuneK(float k)
+    {
+        _k = k;
+        const auto c1 = butterworth_q_inv + k;
+        const auto c2 = 1 / (1 + (k * butterworth_q_inv) + (k * k));
+        _c1.fill(c1);
+        _c2.fill(c2);
+        _c1[_last] = _q_inv_last + k;
+        _c2[_last] = 1 / (1 + (k * _q_inv_last) + (k * k));
+    }
+
+    size_t _last = 0;
+    float _f = -1;
+    float _k = 0;
+    float _q_inv_last = butterworth_q_inv;
+
+    alignas(16) std::array<float, max_stages> _c1{};
+    alignas(16) std::array<float, max_stages> _c2{};
+    alignas(16) std::array<float, max_stages> _s1{};
+    alignas(16) std::array<float, max_stages> _s2{};
+    alignas(16) std::array<float, max_stages> _out{};
+};
+
+// A low-pass and a high-pass SvCascade, of which only the selected one
+// runs. Changing the mode crossfades between the two.
+class SvFilterBank
+{
+public:
+    enum class Mode
+    {
+        low_pass,
+        high_pass,
+    };
+
+    // fade_samples: length of the crossfade when the mode changes
+    explicit SvFilterBank(size_t fade_samples = 240)
+    {
+        setFadeLength(fade_samples);
+    }
+
+    void setFadeLength(size_t fade_samples)
+    {
+        _fade_step = 1.0f / std::max<size_t>(fade_samples, 1);
+    }
+
+    void setStages(size_t stages)
+    {
+        _low_pass.setStages(stages);
+        _high_pass.setStages(stages);
+    }
+
+    void setResonance(float q)
+    {
+        _low_pass.setResonance(q);
+        _high_pass.setResonance(q);
+    }
+
+    void setMode(Mode mode)
+    {
+        if (mode == _mode) { return; }
+        _mode = mode;
+        if (_fade <= 0)
+        {
+            // The incoming cascade has been idle, so start it from silence.
+            (_mode == Mode::low_pass ? _low_pass : _high_pass).reset();
+        }
+        _fade = 1 - _fade;
+    }
+
+    // Corners as fractions of the sample rate. The inactive corner only
+    // matters during a crossfade.
+    void tune(float low_pass_f, float high_pass_f)
+    {
+        if (_mode == Mode::low_pass || _fade > 0)
+        {
+            _low_pass.tune(low_pass_f);
+        }
+        if (_mode == Mode::high_pass || _fade > 0)
+        {
+            _high_pass.tune(high_pass_f);
+        }
+    }
+
+    // Filters size samples, in place if in is out. The stage count is
+    // looked up once per call.
+    void process(const float* in, float* out, size_t size)
+    {
+        switch (_low_pass.stages())
+        {
+        case 1: processStages<1>(in, out, size); break;
+        case 2: processStages<2>(in, out, size); break;
+        case 3: processStages<3>(in, out, size); break;
+        default: processStages<4>(in, out, size); break;
+        }
+    }
+
+    float process(float sample)
+    {
+        process(&sample, &sample, 1);
+        return sample;
+    }
+
+private:
+    static_assert(SvCascade::max_stages == 4);
+
+    template <size_t Stages>
+    void processStages(const float* in, float* out, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            out[i] = processSample<Stages>(in[i]);
+        }
+    }
+
+    template <size_t Stages>
+    float processSample(float sample)
+    {
+        if (_fade <= 0)
+        {
+            return (_mode == Mode::low_pass) ?
+                _low_pass.process<false, Stages>(sample) :
+                _high_pass.process<true, Stages>(sample);
+        }
+
+        // _fade is the share of the outgoing mode.
+        const auto lp = _low_pass.process<false, Stages>(sample);
+        const auto hp = _high_pass.process<true, Stages>(sample);
+        const auto outgoing = (_mode == Mode::low_pass) ? hp : lp;
+        const auto incoming = (_mode == Mode::low_pass) ? lp : hp;
+        const auto out = incoming + (_fade * (outgoing - incoming));
+        _fade = std::max(_fade - _fade_step, 0.0f);
+        return out;
+    }
+
+    float _fade_step;
+    Mode _mode = Mode::low_pass;
+    float _fade = 0;
+    SvCascade _low_pass;
+    SvCascade _high_pass;
+};
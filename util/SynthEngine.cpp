@@ -0,0 +1,474 @@
+#include "SynthEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <q/detail/fast_math.hpp>
+
+#include <util/Mapping.h>
+#include <util/Tcm.h>
+
+namespace
+{
+
+// Time for the synth to fade in or out when the gate opens or closes
+constexpr float gate_fade_time = 0.0026f;
+
+// Samples between wave shape updates while the shape is ramping or
+// modulated
+constexpr size_t shape_step = ModMatrix::step;
+
+// Length of the filter's crossfade between low and high pass
+constexpr float filter_fade_time = 0.005f;
+
+// Time between updates of the derived parameters
+constexpr float control_time = 0.001f;
+
+// Time for the preset blend to catch up when modulation starts or stops
+constexpr float mod_fade_time = 0.05f;
+
+size_t samplesFor(float seconds, float rate)
+{
+    return std::max<size_t>(std::lround(seconds * rate), 1);
+}
+
+// Shared by every engine. Left out of the engine itself, which keeps the
+// engine small enough for tightly coupled memory.
+const WaveTable<>::Tables& waveTables()
+{
+    static WaveTable<>::Tables tables;
+    static bool generated = false;
+    if (!generated)
+    {
+        WaveTable<>::generate(tables);
+        generated = true;
+    }
+    return tables;
+}
+
+} // namespace
+
+
+SynthEngine::SynthEngine(float sample_rate, size_t analysis_decimation) :
+    _sample_rate(sample_rate),
+    _ticks_per_sample(CycleCounter::frequency() / sample_rate),
+    _control_interval(samplesFor(control_time, sample_rate)),
+    _analyzer(sample_rate, analysis_decimation),
+    _gate_ramp(0, LinearRamp::stepFor(gate_fade_time, sample_rate)),
+    _wave_table(waveTables()),
+    _filter_bank(samplesFor(filter_fade_time, sample_rate)),
+    _effect_cache(sample_rate),
+    _mod_ramp(0, LinearRamp::stepFor(mod_fade_time, sample_rate)),
+    _mod(sample_rate)
+{
+    _blend_lfo.set(_blend_settings, sample_rate);
+    _mod.set(_mod_settings);
+    // Only the profile reads it, so other builds skip the boot-time cost.
+    if constexpr (profiling_enabled) { _voice_cost = measureVoiceCost(); }
+}
+
+float SynthEngine::measureVoiceCost()
+{
+    constexpr size_t blocks = 16;
+    constexpr size_t runs = 4;
+    const auto time = [&](const Harmony& harmony) {
+        VoicePool voices;
+        voices.setHarmony(harmony);
+        voices.setFrequency(440, _sample_rate);
+        uint32_t best = std::numeric_limits<uint32_t>::max();
+        for (size_t r = 0; r < runs; ++r)
+        {
+            const auto begin = CycleCounter::now();
+            for (size_t b = 0; b < blocks; ++b)
+            {
+                voices.render(
+                    _wave_table, _oscillator.data(), max_block_size, 1);
+            }
+            best = std::min(best, CycleCounter::now() - begin);
+        }
+        return best;
+    };
+
+    Harmony full;
+    while (full.add({})) {}
+    const auto one = time(Harmony::unison());
+    const auto all = time(full);
+    const auto extra_voice_samples =
+        (full.count - 1) * blocks * max_block_size;
+    return static_cast<float>(all - std::min(all, one)) /
+        extra_voice_samples;
+}
+
+size_t SynthEngine::voiceCapacity() const
+{
+    const auto& total = _profiler.total();
+    if (total.count() == 0 || _voice_cost <= 0) { return 0; }
+
+    const auto budget = _block_size * _ticks_per_sample;
+    const auto spare = budget - static_cast<float>(total.mean());
+    const auto voice_samples = _block_size * _decimator.factor();
+    const auto voices =
+        _voices.count() + (spare / (_voice_cost * voice_samples));
+    return static_cast<size_t>(std::max(voices, 0.0f));
+}
+
+TCM_CODE void SynthEngine::process(
+    const float* in,
+    float* out,
+    size_t size,
+    const EngineParams& params,
+    uint64_t time)
+{
+    _status.note_shift = false;
+    _status.gate_opened = false;
+    while (size > 0)
+    {
+        const auto block_size = std::min(size, max_block_size);
+        processBlock(in, out, block_size, params, time);
+        in += block_size;
+        out += block_size;
+        size -= block_size;
+        time += block_size;
+    }
+}
+
+TCM_CODE void SynthEngine::processBlock(
+    const float* in,
+    float* out,
+    size_t size,
+    const EngineParams& params,
+    uint64_t time)
+{
+    _profiler.beginBlock();
+    _block_size = size;
+
+    if (_control_countdown == 0)
+    {
+        // Until the next update: this block, or enough short blocks to
+        // cover the interval.
+        const auto blocks = (_control_interval + size - 1) / size;
+        _control_countdown = blocks * size;
+        updateControls(params, _control_countdown);
+    }
+    _control_countdown -= std::min(size, _control_countdown);
+    _profiler.lap(Stage::control);
+
+    _analyzer.process(in, size);
+    _status.frequency = _analyzer.frequency();
+    _status.envelope = _analyzer.envelope()[size - 1];
+    _status.note_shift |= _analyzer.noteShift();
+    _status.gate_open = _analyzer.gate()[size - 1];
+    _status.gate_opened |= _analyzer.gateOpened();
+    _profiler.lap(Stage::analysis);
+
+    const auto& c = _effect_cache;
+    shapeEnvelope(size, c.envelopeInfluence());
+    _profiler.lap(Stage::envelope);
+
+    modulate(size, time);
+    _profiler.lap(Stage::modulation);
+
+    renderOscillator(size, c.waveMix(), c.noiseMix());
+    _profiler.lap(Stage::oscillator);
+
+    filter(size, params.envelope_filter_depth);
+    _profiler.lap(Stage::filter);
+
+    const bool levels_modulated = _mod.active(ModDestination::dry_level) ||
+        _mod.active(ModDestination::synth_level);
+    if (params.enable_effect && !levels_modulated)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            const auto synth_signal = _envelope[i] * _filtered[i];
+            out[i] = (in[i] * _dry_ramp()) + (synth_signal * _synth_ramp());
+        }
+    }
+    else if (params.enable_effect)
+    {
+        const auto* dry_mod = _mod.values(ModDestination::dry_level);
+        const auto* synth_mod = _mod.values(ModDestination::synth_level);
+        for (size_t i = 0; i < size; ++i)
+        {
+            const auto k = i / ModMatrix::step;
+            const auto dry = _dry_ramp() * std::max(1 + dry_mod[k], 0.0f);
+            const auto synth =
+                _synth_ramp() * std::max(1 + synth_mod[k], 0.0f);
+            out[i] = (in[i] * dry) + (_envelope[i] * _filtered[i] * synth);
+        }
+    }
+    else
+    {
+        std::copy_n(in, size, out);
+    }
+    _profiler.lap(Stage::mix);
+
+    _profiler.endBlock(static_cast<uint32_t>(size * _ticks_per_sample));
+}
+
+TCM_CODE void SynthEngine::updateControls(
+    const EngineParams& params, size_t ramp)
+{
+    // Only blend when modulating; there's nothing to derive otherwise.
+    _status.mod_ratio = params.apply_mod ? modRatio(params, ramp) : 0;
+    const auto& s =
+        params.apply_mod ?
+            blended(params.preset_state, params.interface_state,
+                _status.mod_ratio) :
+        params.use_preset ? params.preset_state :
+        params.interface_state;
+
+    if (params.trigger_ratio != _trigger_ratio)
+    {
+        constexpr LogMapping trigger_mapping{0.0001, 0.05, 0.4};
+        _trigger_ratio = params.trigger_ratio;
+        _analyzer.setTrigger(trigger_mapping(_trigger_ratio));
+    }
+
+    if (OversamplingDecimator::nearestFactor(params.oversampling) !=
+        _decimator.factor())
+    {
+        setOversampling(params.oversampling);
+    }
+
+    const auto& c = _effect_cache;
+    const auto changed = _effect_cache.update(s, _analyzer.frequency());
+    // Knob changes ramp in until the next update instead of stepping.
+    if (changed & EffectCache::levels_changed)
+    {
+        _dry_ramp.setTarget(c.dryLevel(), ramp);
+        _synth_ramp.setTarget(c.synthLevel(), ramp);
+    }
+    if (changed & EffectCache::shape_changed)
+    {
+        _shape_ramp.setTarget(c.waveShape(), ramp);
+    }
+    if (params.mod != _mod_settings)
+    {
+        _mod_settings = params.mod;
+        _mod.set(_mod_settings);
+        // Let go of whatever the modulation last set.
+        _wave_table.setShape(_shape_ramp.value());
+        _noise_synth.setSampleDuration(
+            c.noiseSampleDuration() * noiseScale());
+    }
+    if (changed & EffectCache::noise_changed)
+    {
+        _noise_synth.setSampleDuration(
+            c.noiseSampleDuration() * noiseScale());
+    }
+    if (changed & EffectCache::filter_changed)
+    {
+        // A resonance change alone leaves the corners still.
+        const auto glide = [ramp](BlockRamp& corner, float target) {
+            if (target != corner.target()) { corner.setTarget(target, ramp); }
+        };
+        _filter_bank.setResonance(c.resonance());
+        glide(_low_pass_corner, c.lowPassCorner() / _sample_rate);
+        glide(_high_pass_corner, c.highPassCorner() / _sample_rate);
+        _filter_bank.setMode((c.lowPassMix() > 0) ?
+            SvFilterBank::Mode::low_pass :
+            SvFilterBank::Mode::high_pass);
+    }
+    if (params.harmony != _harmony)
+    {
+        _harmony = params.harmony;
+        _voices.setHarmony(_harmony);
+        _wave_table.setFrequency(_voices.highestFrequency(),
+            _sample_rate * _decimator.factor());
+    }
+    _filter_bank.setStages(params.filter_stages);
+}
+
+void SynthEngine::setOversampling(size_t factor)
+{
+    _decimator.setFactor(factor);
+    factor = _decimator.factor();
+    const auto rate = _sample_rate * factor;
+    _voices.setFrequency(_voices.frequency(), rate);
+    _wave_table.setFrequency(_voices.highestFrequency(), rate);
+    _noise_synth.setSampleDuration(
+        _effect_cache.noiseSampleDuration() * noiseScale());
+    _filter_bank.setFadeLength(samplesFor(filter_fade_time, rate));
+}
+
+float SynthEngine::noiseScale() const
+{
+    return _sample_rate * _decimator.factor() / EffectState::noise_tuned_rate;
+}
+
+TCM_CODE float SynthEngine::modRatio(
+    const EngineParams& params, size_t samples)
+{
+    // A sine over mod_duration: a one-shot moves from the preset to the
+    // knobs and stays there.
+    const LfoSettings blend{LfoSettings::Shape::sine,
+        1000.0f / std::max(params.mod_duration, 1.0f),
+        params.cycle_mod, true};
+    if (blend != _blend_settings)
+    {
+        _blend_settings = blend;
+        _blend_lfo.set(blend, _sample_rate);
+    }
+    return _mod_ramp(_blend_lfo.value(), samples);
+}
+
+TCM_CODE void SynthEngine::modulate(size_t size, uint64_t time)
+{
+    const bool retriggered = _analyzer.noteShift() || _analyzer.gateOpened();
+    const auto retrigger = retriggered ? _analyzer.retriggerIndex() : size;
+    if (retriggered) { _retrigger_time.store(time + retrigger); }
+    _blend_lfo.advance(size, retrigger);
+    _mod.process(size, retrigger, _analyzer.envelope());
+}
+
+TCM_CODE void SynthEngine::shapeEnvelope(
+    size_t size, float influence)
+{
+    constexpr auto no_envelope = 1 / EffectState::max_level;
+    const auto* dry_envelope = _analyzer.envelope();
+    const auto* gate = _analyzer.gate();
+    for (size_t i = 0; i < size; ++i)
+    {
+        const auto gate_level = _gate_ramp(gate[i] ? 1 : 0);
+        _envelope[i] = gate_level *
+            std::lerp(no_envelope, dry_envelope[i], influence);
+    }
+}
+
+TCM_CODE void SynthEngine::renderOscillator(
+    size_t size, float wave_mix, float noise_mix)
+{
+    const auto factor = _decimator.factor();
+    const auto rate = _sample_rate * factor;
+    const auto length = size * factor;
+    const auto step = shape_step * factor;
+    const bool shape_modulated = _mod.active(ModDestination::shape);
+    const auto* shape_mod = _mod.values(ModDestination::shape);
+
+    // Pitch changes split the block into runs at a constant frequency, and
+    // a ramping shape splits it into runs of shape_step samples.
+    const auto* events = _analyzer.pitchEvents();
+    const auto event_count = _analyzer.pitchEventCount();
+    size_t e = 0;
+    for (size_t begin = 0; begin < length;)
+    {
+        if ((_shape_ramp.ramping() || shape_modulated) &&
+            (begin % step == 0))
+        {
+            const auto shape = _shape_ramp.advance(
+                std::min(shape_step, (length - begin) / factor));
+            _wave_table.setShape(shape + shape_mod[begin / step]);
+        }
+
+        for (; (e < event_count) && (events[e].index * factor <= begin);
+            ++e)
+        {
+            _voices.setFrequency(events[e].frequency, rate);
+            // The highest voice sets the band limit for all of them.
+            _wave_table.setFrequency(_voices.highestFrequency(), rate);
+        }
+
+        auto end = std::min(length, ((begin / step) + 1) * step);
+        if (e < event_count)
+        {
+            end = std::min<size_t>(end, events[e].index * factor);
+        }
+        renderWave(begin, end, wave_mix);
+        begin = end;
+    }
+
+    if (noise_mix != 0)
+    {
+        renderNoise(length, noise_mix);
+    }
+}
+
+TCM_CODE void SynthEngine::renderNoise(size_t length, float gain)
+{
+    if (!_mod.active(ModDestination::noise_rate))
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            _oscillator[i] += _noise_synth() * gain;
+        }
+        return;
+    }
+
+    // A higher rate holds each noise sample for less time.
+    const auto factor = _decimator.factor();
+    const auto step = ModMatrix::step * factor;
+    const auto duration = _effect_cache.noiseSampleDuration() * noiseScale();
+    const auto* rate_mod = _mod.values(ModDestination::noise_rate);
+    for (size_t begin = 0; begin < length; begin += step)
+    {
+        _noise_synth.setSampleDuration(static_cast<int>(
+            duration * fasterpow2(-rate_mod[begin / step])));
+        const auto end = std::min(begin + step, length);
+        for (size_t i = begin; i < end; ++i)
+        {
+            _oscillator[i] += _noise_synth() * gain;
+        }
+    }
+}
+
+TCM_CODE void SynthEngine::renderWave(
+    size_t begin, size_t end, float gain)
+{
+    if (gain == 0)
+    {
+        // The phases keep running so the voices are in step when they
+        // return.
+        std::fill(_oscillator.begin() + begin, _oscillator.begin() + end, 0);
+        _voices.advance(end - begin);
+        return;
+    }
+
+    _voices.render(_wave_table, _oscillator.data() + begin, end - begin,
+        gain * _wave_table.boost());
+}
+
+TCM_CODE void SynthEngine::filter(
+    size_t size, float envelope_depth)
+{
+    const auto factor = _decimator.factor();
+    // From fractions of the base rate to the oversampled one
+    const auto to_rate = 1.0f / factor;
+
+    const bool modulated = _mod.active(ModDestination::filter);
+    const auto* corner_mod = _mod.values(ModDestination::filter);
+    const bool sweeping =
+        _low_pass_corner.ramping() || _high_pass_corner.ramping() ||
+        (envelope_depth != 0) || modulated;
+    if (!sweeping)
+    {
+        // Only retunes if the corners moved since the last block.
+        _filter_bank.tune(_low_pass_corner.value() * to_rate,
+            _high_pass_corner.value() * to_rate);
+        _filter_bank.process(_oscillator.data(), _filtered.data(),
+            size * factor);
+    }
+    else
+    {
+        // Glide the corners to their new targets, rather than jumping at
+        // the block boundary, and follow the envelope and modulation if
+        // asked. They move once per base rate sample.
+        float mod_scale = 1;
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (modulated && (i % ModMatrix::step == 0))
+            {
+                mod_scale = fasterpow2(corner_mod[i / ModMatrix::step]);
+            }
+            const auto scale = (1 + (envelope_depth * _envelope[i])) *
+                mod_scale * to_rate;
+            _filter_bank.tune(
+                _low_pass_corner() * scale, _high_pass_corner() * scale);
+            _filter_bank.process(_oscillator.data() + (i * factor),
+                _filtered.data() + (i * factor), factor);
+        }
+    }
+
+    _decimator.process(_filtered.data(), _filtered.data(), size);
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <util/Analyzer.h>
+#include <util/EffectCache.h>
+#include <util/EffectState.h>
+#include <util/HalfBand.h>
+#include <util/LinearRamp.h>
+#include <util/ModMatrix.h>
+#include <util/NoiseSynth.h>
+#include <util/Profiler.h>
+#include <util/SampleCounter.h>
+#include <util/SvFilterBank.h>
+#include <util/VoicePool.h>
+#include <util/WaveTable.h>
+
+// Everything the control side hands to the audio side.
+struct EngineParams
+{
+    EffectState interface_state;
+    EffectState preset_state;
+    bool enable_effect = false;
+    bool use_preset = false;
+    bool apply_mod = false;
+    bool cycle_mod = false;
+    // Period of the preset blend, in ms, to a fraction of a sample
+    float mod_duration = 1000;
+    float trigger_ratio = 1;
+    // Scales the filter corners by (1 + depth * synth envelope).
+    float envelope_filter_depth = 0;
+    // Cascaded filter stages, 12 dB/octave each
+    size_t filter_stages = 1;
+    // Voices played for each detected note
+    Harmony harmony;
+    // The oscillator and filter run at this multiple of the sample rate:
+    // 1, 2 or 4
+    size_t oversampling = 1;
+    // LFOs and the dry envelope, routed to parts of the synth
+    ModSettings mod;
+};
+
+// What the engine saw during the last call to process, for telemetry
+struct EngineStatus
+{
+    float frequency = 0;
+    // Dry envelope at the end of the call
+    float envelope = 0;
+    // Blend from the preset (0) to the knobs (1), 0 when not modulating
+    float mod_ratio = 0;
+    bool note_shift = false;
+    // The gate at the end of the call, and whether it opened during it
+    bool gate_open = false;
+    bool gate_opened = false;
+};
+
+// The complete synth signal chain, independent of the Daisy hardware.
+class SynthEngine
+{
+public:
+    enum class Stage
+    {
+        control,
+        analysis,
+        envelope,
+        modulation,
+        oscillator,
+        filter,
+        mix,
+        count
+    };
+
+    static constexpr std::array<const char*, Profiler<Stage>::stage_count>
+        stage_names{
+            "control", "analysis", "envelope", "modulation", "oscillator",
+            "filter", "mix"};
+
+    // Blocks longer than this are processed in several passes.
+    static constexpr size_t max_block_size = Analyzer::max_block_size;
+    static_assert(ModMatrix::max_block_size == max_block_size);
+
+    static constexpr size_t max_oversampling =
+        OversamplingDecimator::max_factor;
+
+    // analysis_decimation: 1, 2 or 4; see Analyzer
+    explicit SynthEngine(float sample_rate, size_t analysis_decimation = 1);
+
+    // Processes one block of mono audio. time is the sample clock at the
+    // start of the block.
+    void process(
+        const float* in,
+        float* out,
+        size_t size,
+        const EngineParams& params,
+        uint64_t time);
+
+    float sampleRate() const { return _sample_rate; }
+
+    // Sample clock time of the last note shift or gate opening, which
+    // restarted the modulation. Safe to read from the control loop.
+    uint64_t lastRetrigger() const { return _retrigger_time.load(); }
+
+    const EngineStatus& status() const { return _status; }
+
+    // Derived effect parameters, with a count of how often they change.
+    const EffectCache& effectCache() const { return _effect_cache; }
+
+    // Stage timings. Only collected when TERRARIUM_PROFILE is defined.
+    Profiler<Stage>& profiler() { return _profiler; }
+    const Profiler<Stage>& profiler() const { return _profiler; }
+
+    // CycleCounter ticks to render one voice for one sample, measured when
+    // the engine is constructed. Needs TERRARIUM_PROFILE; 0 otherwise.
+    float voiceCost() const { return _voice_cost; }
+
+    // How many voices would fit in the time left over by the profiled
+    // blocks, counting the ones playing now. Needs TERRARIUM_PROFILE.
+    size_t voiceCapacity() const;
+
+private:
+    // Each stage runs over the whole block before the next one starts.
+    void processBlock(
+        const float* in,
+        float* out,
+        size_t size,
+        const EngineParams& params,
+        uint64_t time);
+
+    // Brings the derived parameters up to date, ramping the changes in
+    // over ramp samples.
+    void updateControls(const EngineParams& params, size_t ramp);
+
+    // Blend ratio between the preset and the knobs, which can move at
+    // most so far in samples.
+    float modRatio(const EngineParams& params, size_t samples);
+
+    // Runs the modulation over the block, restarting it on a note shift or
+    // when the gate opens.
+    void modulate(size_t size, uint64_t time);
+
+    // Moves the oscillator and filter to a new multiple of the sample rate.
+    void setOversampling(size_t factor);
+
+    // Scales noise sample durations, tuned at 48 kHz, to the oversampled
+    // rate.
+    float noiseScale() const;
+
+    // Fills _envelope from the analysis results.
+    void shapeEnvelope(size_t size, float influence);
+
+    // Times rendering with every voice against a single one.
+    float measureVoiceCost();
+
+    // Fill _oscillator, then _filtered, at the oversampled rate, and
+    // bring _filtered back down to size samples.
+    void renderOscillator(size_t size, float wave_mix, float noise_mix);
+    void renderNoise(size_t length, float gain);
+    void renderWave(size_t begin, size_t end, float gain);
+    void filter(size_t size, float envelope_depth);
+
+    const float _sample_rate;
+    const float _ticks_per_sample;
+    // Samples between updates of the derived parameters, about a
+    // millisecond. Shorter blocks share an update, so their per-block cost
+    // stays low; longer ones get one each.
+    const size_t _control_interval;
+    Profiler<Stage> _profiler;
+
+    Analyzer _analyzer;
+    LinearRamp _gate_ramp;
+    Harmony _harmony;
+    VoicePool _voices;
+    WaveTable<> _wave_table;
+    BlockRamp _shape_ramp;
+    NoiseSynth _noise_synth;
+    SvFilterBank _filter_bank;
+    OversamplingDecimator _decimator;
+    // Corners, as fractions of the base sample rate
+    BlockRamp _low_pass_corner;
+    BlockRamp _high_pass_corner;
+    EffectCache _effect_cache;
+    // Samples until the next control update
+    size_t _control_countdown = 0;
+    float _trigger_ratio = -1;
+    // Drives the blend between the preset and the knobs
+    Lfo _blend_lfo;
+    LfoSettings _blend_settings{};
+    // Stepped by the samples between control updates. With an update
+    // every 48 samples at 48 kHz, that's exactly 0.02 an update.
+    LinearRamp _mod_ramp;
+    SampleCounter _retrigger_time;
+    EngineStatus _status;
+    ModMatrix _mod;
+    ModSettings _mod_settings;
+    BlockRamp _dry_ramp;
+    BlockRamp _synth_ramp;
+    size_t _block_size = max_block_size;
+    float _voice_cost = 0;
+
+    std::array<float, max_block_size> _envelope;
+    std::array<float, max_block_size * max_oversampling> _oscillator;
+    std::array<float, max_block_size * max_oversampling> _filtered;
+};
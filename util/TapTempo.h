@@ -2,16 +2,17 @@
 
 #include <cstdint>
 
+// Times are counts of samples, from the same clock as the audio.
 class TapTempo
 {
 public:
-    explicit TapTempo(uint32_t interval, uint32_t max_interval = 2000) :
+    explicit TapTempo(uint64_t interval, uint64_t max_interval) :
         _max_interval(max_interval),
         _interval(interval)
     {
     }
 
-    void Update(uint32_t now)
+    void Update(uint64_t now)
     {
         _now = now;
     }
@@ -27,7 +28,7 @@ public:
         _last_tap = _now;
     }
 
-    uint32_t Interval() const
+    uint64_t Interval() const
     {
         return _interval;
     }
@@ -38,16 +39,16 @@ public:
         return static_cast<float>(elapsed % _interval) / _interval;
     }
 
-    uint32_t SinceTap() const
+    uint64_t SinceTap() const
     {
         return _now - _last_tap;
     }
 
 private:
-    const uint32_t _max_interval;
-    uint32_t _interval;
+    const uint64_t _max_interval;
+    uint64_t _interval;
 
-    uint32_t _now = 0;
-    uint32_t _last_tap = 0;
-    uint32_t _start = 0;
+    uint64_t _now = 0;
+    uint64_t _last_tap = 0;
+    uint64_t _start = 0;
 };
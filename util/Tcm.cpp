@@ -0,0 +1,34 @@
+#include "Tcm.h"
+
+#if defined(__arm__) && defined(TERRARIUM_TCM)
+
+#include <cstdint>
+#include <cstring>
+
+#include <stm32h7xx.h>
+
+// Defined by tcm.ld. The load addresses are where the contents sit in
+// flash.
+extern "C" uint8_t _sitcm_text, _eitcm_text, _litcm_text;
+extern "C" uint8_t _sdtcm_data, _edtcm_data, _ldtcm_data;
+extern "C" uint8_t _sdtcm_bss, _edtcm_bss;
+
+namespace
+{
+
+// Runs ahead of the constructors with the default priority, which may
+// build objects in DTCM or call code in ITCM.
+__attribute__((constructor(101), used)) void initTcm()
+{
+    std::memcpy(&_sitcm_text, &_litcm_text, &_eitcm_text - &_sitcm_text);
+    std::memcpy(&_sdtcm_data, &_ldtcm_data, &_edtcm_data - &_sdtcm_data);
+    std::memset(&_sdtcm_bss, 0, &_edtcm_bss - &_sdtcm_bss);
+
+    // Finish the copy before any of the code runs.
+    __DSB();
+    __ISB();
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+// Places the audio path in the Cortex-M7's tightly coupled memories. The
+// core reaches them in a single cycle, without the AXI bus or the caches,
+// so QSPI and SDRAM traffic from the control loop can't stall it.
+//
+//   TCM_CODE  a function, in ITCM
+//   TCM_DATA  a variable with a constant initial value, in DTCM
+//   TCM_BSS   a variable that starts out all zeros, in DTCM
+//
+// TCM_BSS is cleared rather than loaded, so it's only for variables whose
+// constant initial value is zero, such as an empty std::optional. Objects
+// built by a constructor at startup can use either.
+//
+// tcm.ld adds the sections to libDaisy's linker script, and Tcm.cpp fills
+// them before the constructors run. The build prints what landed in each
+// memory and how much is left. Host builds, and firmware configured with
+// -DTERRARIUM_TCM=OFF, leave everything where it was.
+#if defined(__arm__) && defined(TERRARIUM_TCM)
+#define TCM_CODE __attribute__((section(".itcm_text")))
+#define TCM_DATA __attribute__((section(".dtcm_data")))
+#define TCM_BSS __attribute__((section(".dtcm_bss")))
+#else
+#define TCM_CODE
+#define TCM_DATA
+#define TCM_BSS
+#endif
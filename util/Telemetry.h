@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <util/SlotLog.h>
+
+// What the audio callback saw in one or more blocks.
+struct TelemetryRecord
+{
+    enum Flags : uint8_t
+    {
+        note_shift = 1 << 0,
+        // The gate at the end of the record's last block
+        gate_open = 1 << 1,
+        gate_opened = 1 << 2,
+    };
+
+    // Sample clock at the start of the first block, low 32 bits
+    uint32_t time = 0;
+    float frequency = 0;
+    // Dry envelope and preset blend, 0 to 1, at the end of the last block
+    float envelope = 0;
+    float mod_ratio = 0;
+    // Most CPU cycles taken by one block
+    uint32_t cycles = 0;
+    uint8_t flags = 0;
+    // Audio blocks merged into this record
+    uint8_t blocks = 0;
+    // Records dropped since start-up, wrapping; filled in when sent
+    uint16_t dropped = 0;
+};
+
+// Records on the wire are frames of fixed size, little-endian:
+//
+//   sync 0x54 0xC3, time u32, frequency f32, envelope u16, mod ratio u16,
+//   cycles u32, flags u8, blocks u8, dropped u16, CRC-32C of the rest
+//   (low 16 bits)
+//
+// The sync bytes and CRC let a reader find its way back in after lost
+// bytes, or text from the log sharing the port.
+namespace telemetry
+{
+
+constexpr std::array<uint8_t, 2> sync{0x54, 0xC3};
+constexpr size_t payload_size = 20;
+constexpr size_t frame_size = sync.size() + payload_size + 2;
+
+inline uint16_t toUnit(float x)
+{
+    return static_cast<uint16_t>(std::clamp(x, 0.0f, 1.0f) * 65535 + 0.5f);
+}
+
+inline float fromUnit(uint16_t x) { return x / 65535.0f; }
+
+inline uint8_t* put(uint8_t* p, uint32_t x, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        *p++ = static_cast<uint8_t>(x >> (8 * i));
+    }
+    return p;
+}
+
+inline uint32_t get(const uint8_t*& p, size_t bytes)
+{
+    uint32_t x = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        x |= static_cast<uint32_t>(*p++) << (8 * i);
+    }
+    return x;
+}
+
+inline uint16_t check(const uint8_t* payload)
+{
+    return static_cast<uint16_t>(Crc32c::calculate(payload, payload_size));
+}
+
+// Writes frame_size bytes to out.
+inline void encode(const TelemetryRecord& r, uint8_t* out)
+{
+    uint32_t frequency;
+    std::memcpy(&frequency, &r.frequency, sizeof(frequency));
+
+    auto* p = std::copy(sync.begin(), sync.end(), out);
+    const auto* payload = p;
+    p = put(p, r.time, 4);
+    p = put(p, frequency, 4);
+    p = put(p, toUnit(r.envelope), 2);
+    p = put(p, toUnit(r.mod_ratio), 2);
+    p = put(p, r.cycles, 4);
+    p = put(p, r.flags, 1);
+    p = put(p, r.blocks, 1);
+    p = put(p, r.dropped, 2);
+    put(p, check(payload), 2);
+}
+
+// Reads a frame from in, which must hold frame_size bytes. Returns false
+// if it isn't a whole, valid frame.
+inline bool decode(const uint8_t* in, TelemetryRecord& r)
+{
+    if (!std::equal(sync.begin(), sync.end(), in)) { return false; }
+    const auto* p = in + sync.size();
+    const auto* payload = p;
+    r.time = get(p, 4);
+    const auto frequency = get(p, 4);
+    std::memcpy(&r.frequency, &frequency, sizeof(r.frequency));
+    r.envelope = fromUnit(static_cast<uint16_t>(get(p, 2)));
+    r.mod_ratio = fromUnit(static_cast<uint16_t>(get(p, 2)));
+    r.cycles = get(p, 4);
+    r.flags = static_cast<uint8_t>(get(p, 1));
+    r.blocks = static_cast<uint8_t>(get(p, 1));
+    r.dropped = static_cast<uint16_t>(get(p, 2));
+    return get(p, 2) == check(payload);
+}
+
+} // namespace telemetry
+
+// Hands records from the audio callback to the control loop. push and pop
+// are wait-free, for one producer and one consumer. When the ring is full
+// push drops the record and counts it, rather than waiting. A ring of no
+// records drops them all, for builds without telemetry.
+template <size_t Capacity = 256>
+class TelemetryRing
+{
+public:
+    static_assert((Capacity & (Capacity - 1)) == 0,
+        "Capacity must be a power of two");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    // Producer side
+    bool push(const TelemetryRecord& record)
+    {
+        const auto head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == Capacity)
+        {
+            _dropped.store(_dropped.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            return false;
+        }
+        _records[head % Capacity] = record;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: copies up to max records to out, oldest first, and
+    // returns how many.
+    size_t pop(TelemetryRecord* out, size_t max)
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        const auto count = std::min<size_t>(
+            _head.load(std::memory_order_acquire) - tail, max);
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = _records[(tail + i) % Capacity];
+        }
+        _tail.store(tail + static_cast<uint32_t>(count),
+            std::memory_order_release);
+        return count;
+    }
+
+    uint32_t dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::array<TelemetryRecord, Capacity> _records{};
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    std::atomic<uint32_t> _dropped{0};
+};
+
+// The audio callback's end: merges decimation blocks into each record, so
+// a note shift or gate opening in any of them still shows.
+template <size_t Capacity = 256>
+class TelemetryRecorder
+{
+public:
+    explicit TelemetryRecorder(size_t decimation = 1) :
+        _decimation(std::clamp<size_t>(decimation, 1, 255))
+    {}
+
+    void record(const TelemetryRecord& block)
+    {
+        if (_blocks == 0)
+        {
+            _pending = block;
+        }
+        else
+        {
+            _pending.frequency = block.frequency;
+            _pending.envelope = block.envelope;
+            _pending.mod_ratio = block.mod_ratio;
+            _pending.cycles = std::max(_pending.cycles, block.cycles);
+            _pending.flags = (_pending.flags & ~TelemetryRecord::gate_open) |
+                block.flags;
+        }
+
+        if (++_blocks == _decimation)
+        {
+            _pending.blocks = static_cast<uint8_t>(_blocks);
+            _ring.push(_pending);
+            _blocks = 0;
+        }
+    }
+
+    TelemetryRing<Capacity>& ring() { return _ring; }
+
+private:
+    const size_t _decimation;
+    size_t _blocks = 0;
+    TelemetryRecord _pending;
+    TelemetryRing<Capacity> _ring;
+};
+
+// The control loop's end: encodes records from a ring and writes them to
+// a port, up to Batch at a time. Port provides:
+//
+//   bool write(const uint8_t* data, size_t size); // false if busy
+//
+// A batch the port turns away is offered again on the next call.
+template <size_t Batch = 16>
+class TelemetrySender
+{
+public:
+    // Returns the number of records sent.
+    template <typename Port, size_t Capacity>
+    size_t step(TelemetryRing<Capacity>& ring, Port& port)
+    {
+        if (_count == 0)
+        {
+            std::array<TelemetryRecord, Batch> records;
+            _count = ring.pop(records.data(), Batch);
+            const auto dropped = static_cast<uint16_t>(ring.dropped());
+            for (size_t i = 0; i < _count; ++i)
+            {
+                records[i].dropped = dropped;
+                telemetry::encode(
+                    records[i], _frames.data() + (i * telemetry::frame_size));
+            }
+        }
+        if (_count == 0 ||
+            !port.write(_frames.data(), _count * telemetry::frame_size))
+        {
+            return 0;
+        }
+        return std::exchange(_count, 0);
+    }
+
+    // False while a batch the port turned away is waiting
+    bool idle() const { return _count == 0; }
+
+private:
+    std::array<uint8_t, Batch * telemetry::frame_size> _frames{};
+    size_t _count = 0;
+};
+
+// Finds frames in a byte stream, skipping anything else.
+class TelemetryParser
+{
+public:
+    // Calls on_record for each frame completed by data.
+    template <typename F>
+    void feed(const uint8_t* data, size_t size, F&& on_record)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            _frame[_size++] = data[i];
+            // Until the sync bytes are in place, slide along.
+            if (_size <= telemetry::sync.size() &&
+                _frame[_size - 1] != telemetry::sync[_size - 1])
+            {
+                const size_t kept = (data[i] == telemetry::sync[0]) ? 1 : 0;
+                _skipped += _size - kept;
+                _size = kept;
+                continue;
+            }
+            if (_size < telemetry::frame_size) { continue; }
+
+            TelemetryRecord record;
+            if (telemetry::decode(_frame.data(), record))
+            {
+                on_record(record);
+                _size = 0;
+                continue;
+            }
+
+            // Not a frame after all: look again from the next byte.
+            _bad++;
+            const auto rest = rescan();
+            _skipped += _size - rest;
+            _size = rest;
+        }
+    }
+
+    // Bytes that weren't part of a frame, and frames that failed the CRC
+    size_t skipped() const { return _skipped; }
+    size_t bad() const { return _bad; }
+
+private:
+    // Moves the longest tail of the buffer that could start a frame to the
+    // front, and returns its length.
+    size_t rescan()
+    {
+        for (size_t start = 1; start < _size; ++start)
+        {
+            const auto length = _size - start;
+            const auto checked = std::min(length, telemetry::sync.size());
+            if (std::equal(telemetry::sync.begin(),
+                    telemetry::sync.begin() + checked,
+                    _frame.begin() + start))
+            {
+                std::copy(_frame.begin() + start, _frame.begin() + _size,
+                    _frame.begin());
+                return length;
+            }
+        }
+        return 0;
+    }
+
+    std::array<uint8_t, telemetry::frame_size> _frame{};
+    size_t _size = 0;
+    size_t _skipped = 0;
+    size_t _bad = 0;
+};
@@ -1,41 +1,112 @@
 #include "Terrarium.h"
 
-void Terrarium::Init(bool boost)
+#include <algorithm>
+#include <cstddef>
+
+// The settings in QSPI flash: the old single-preset slots, at the start
+// where earlier firmware left them, then the preset bank. Being one object
+// fixes their order; qspi.ld fails the link unless it starts the flash.
+struct QspiSettings
+{
+    alignas(LegacySettingsSlot)
+        uint8_t legacy[legacy_slot_count * sizeof(LegacySettingsSlot)];
+    alignas(4096) uint8_t bank[settings_bank_size];
+};
+static_assert(offsetof(QspiSettings, legacy) == 0);
+
+extern "C"
+{
+__attribute__((used)) QspiSettings DSY_QSPI_BSS terrarium_qspi_settings;
+}
+
+namespace
+{
+
+uint32_t bankAddress(size_t offset)
+{
+    return reinterpret_cast<uint32_t>(terrarium_qspi_settings.bank) +
+        offset;
+}
+
+// Time between knob updates
+constexpr float knob_update_time = 0.001f;
+
+// Profiling copies QSPI flash into SDRAM through a span much bigger than
+// the data cache.
+constexpr uintptr_t qspi_address = 0x90000000;
+constexpr size_t traffic_span = 256 * 1024;
+uint8_t DSY_SDRAM_BSS traffic_buffer[traffic_span];
+
+} // namespace
+
+const uint8_t* QspiFlash::data() const
+{
+    return terrarium_qspi_settings.bank;
+}
+
+bool QspiFlash::erase(size_t offset, size_t size)
+{
+    return _qspi.Erase(bankAddress(offset), bankAddress(offset + size)) ==
+        daisy::QSPIHandle::Result::OK;
+}
+
+bool QspiFlash::write(size_t offset, const uint8_t* data, size_t size)
+{
+    return _qspi.Write(bankAddress(offset), size,
+        const_cast<uint8_t*>(data)) == daisy::QSPIHandle::Result::OK;
+}
+
+void Terrarium::Init(bool boost, size_t block_size)
 {
     seed.Init(boost);
+    seed.SetAudioBlockSize(block_size);
     InitKnobs();
     InitToggles();
     InitStomps();
     InitLeds();
 }
 
-void Terrarium::Loop(float frequency, std::function<void()> callback)
+void Terrarium::SetSampleRate(float sample_rate)
 {
-    for (auto& knob : knobs)
+    using Rate = daisy::SaiHandle::Config::SampleRate;
+    seed.SetAudioSampleRate(
+        (sample_rate < 40000) ? Rate::SAI_32KHZ :
+        (sample_rate < 72000) ? Rate::SAI_48KHZ :
+        Rate::SAI_96KHZ);
+    InitKnobRate();
+}
+
+void Terrarium::DebounceSwitches()
+{
+    for (auto& toggle : toggles)
     {
-        knob.SetSampleRate(frequency);
+        toggle.Debounce();
     }
 
-    const auto interval =
-        static_cast<uint32_t>(daisy::System::GetTickFreq() / frequency);
-    auto wait_begin = daisy::System::GetTick();
-    while (true)
+    for (auto& stomp : stomps)
     {
-        for (auto& toggle : toggles)
-        {
-            toggle.Debounce();
-        }
+        stomp.Debounce();
+    }
+}
 
-        for (auto& stomp : stomps)
-        {
-            stomp.Debounce();
-        }
+bool Terrarium::WriteUsb(const uint8_t* data, size_t size)
+{
+    return seed.usb_handle.TransmitInternal(const_cast<uint8_t*>(data),
+        size) == daisy::UsbHandle::Result::OK;
+}
 
-        callback();
+void Terrarium::StreamMemory()
+{
+    static size_t offset = 0;
+    const auto* qspi = reinterpret_cast<const uint8_t*>(qspi_address);
+    std::copy_n(qspi + offset, traffic_chunk, traffic_buffer + offset);
+    offset = (offset + traffic_chunk) % traffic_span;
+}
 
-        while ((daisy::System::GetTick() - wait_begin) < interval) {}
-        wait_begin += interval;
-    }
+const LegacySettingsSlot* Terrarium::LegacySlots()
+{
+    return reinterpret_cast<const LegacySettingsSlot*>(
+        terrarium_qspi_settings.legacy);
 }
 
 void Terrarium::InitKnobs()
@@ -57,8 +128,17 @@ void Terrarium::InitKnobs()
 
     seed.adc.Init(adc_configs.data(), adc_configs.size());
     seed.adc.Start();
+    InitKnobRate();
+}
+
+void Terrarium::InitKnobRate()
+{
+    const auto samples_per_update = static_cast<size_t>(
+        seed.AudioSampleRate() * knob_update_time);
+    _knob_interval = std::max<size_t>(
+        samples_per_update / seed.AudioBlockSize(), 1);
 
-    const auto poll_rate = seed.AudioCallbackRate();
+    const auto poll_rate = seed.AudioCallbackRate() / _knob_interval;
     for (int i = 0; i < knob_count; ++i)
     {
         knobs[i].Init(seed.adc.GetPtr(i), poll_rate);
@@ -1,23 +1,98 @@
 #pragma once
 
 #include <array>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
 
 #include <daisy_seed.h>
 
 #include <util/Led.h>
+#include <util/PersistentSettings.h>
 
+// Scheduler clock for the Daisy Seed: the libDaisy tick timer, sleeping
+// until the next interrupt when idle. The SysTick and audio interrupts
+// wake the core at least once a millisecond.
+struct DaisyClock
+{
+    static uint32_t now() { return daisy::System::GetTick(); }
+    static uint32_t frequency() { return daisy::System::GetTickFreq(); }
+    static void idle() { __WFI(); }
+};
+
+// The settings bank's part of the QSPI chip, read through the memory
+// mapping and changed through the QSPI peripheral
+class QspiFlash
+{
+public:
+    static constexpr size_t sector_size = 4096;
+
+    explicit QspiFlash(daisy::QSPIHandle& qspi) : _qspi(qspi) {}
+
+    size_t size() const { return settings_bank_size; }
+    const uint8_t* data() const;
+
+    bool erase(size_t offset, size_t size);
+    bool write(size_t offset, const uint8_t* data, size_t size);
+
+private:
+    daisy::QSPIHandle& _qspi;
+};
+
+// The pedal's hardware, and everything the control logic in Pedal needs
+// from it. host/SimTerrarium.h has the same interface on Linux.
 class Terrarium
 {
 public:
+    using Clock = DaisyClock;
+    using AudioCallback = daisy::AudioHandle::AudioCallback;
+
+    // Bytes StreamMemory copies per call
+    static constexpr size_t traffic_chunk = 4 * 1024;
+
+    Terrarium() : _flash(seed.qspi), _settings(_flash, LegacySlots()) {}
+
     // Initializes the Daisy Seed hardware and the Terrarium interface.
     // Call this method before using other members of this class.
-    void Init(bool boost = false);
+    // block_size is the number of samples per audio callback.
+    void Init(bool boost = false, size_t block_size = 48);
+
+    // Audio callbacks per knob update. Short blocks share one, so the
+    // knobs are read about once a millisecond whatever the block size.
+    size_t KnobInterval() const { return _knob_interval; }
+
+    // Debounces the Terrarium toggle and stomp switches. Call this at a
+    // steady rate.
+    void DebounceSwitches();
+
+    // Switches the audio to 32, 48 or 96 kHz, whichever is nearest, and
+    // keeps the knob updates about a millisecond apart. Call this before
+    // StartAudio.
+    void SetSampleRate(float sample_rate);
+
+    float SampleRate() { return seed.AudioSampleRate(); }
+    void StartAudio(AudioCallback callback) { seed.StartAudio(callback); }
+
+    // Microseconds since the clocks started
+    uint32_t Micros() const { return daisy::System::GetUs(); }
 
-    // Start an infinite loop that executes at the given frequency in hertz.
-    // Sets the Terrarium knob sample rates to match the loop frequency.
-    // Automatically debounces the Terrarium toggle and stomp switches.
-    void Loop(float frequency, std::function<void()> callback);
+    // Printing goes to the USB serial port, once StartLog has opened it.
+    void StartLog() { seed.StartLog(); }
+
+    template <typename... Args>
+    void PrintLine(const char* format, Args... args)
+    {
+        seed.PrintLine(format, args...);
+    }
+
+    // Sends raw bytes over the USB serial port. Returns false if it's
+    // busy.
+    bool WriteUsb(const uint8_t* data, size_t size);
+
+    // Copies the next traffic_chunk of QSPI flash into SDRAM, to load the
+    // buses while profiling.
+    void StreamMemory();
+
+    PersistentSettings<QspiFlash>& Settings() { return _settings; }
 
     daisy::DaisySeed seed;
 
@@ -26,14 +101,22 @@ public:
     static constexpr int stomp_count = 2;
     static constexpr int led_count = 2;
 
+    // Set up to be processed once every KnobInterval() audio callbacks
     std::array<daisy::AnalogControl, knob_count> knobs;
     std::array<daisy::Switch, toggle_count> toggles;
     std::array<daisy::Switch, stomp_count> stomps;
     std::array<Led, led_count> leds;
 
 private:
+    static const LegacySettingsSlot* LegacySlots();
+
     void InitKnobs();
     void InitToggles();
     void InitStomps();
     void InitLeds();
+    void InitKnobRate();
+
+    size_t _knob_interval = 1;
+    QspiFlash _flash;
+    PersistentSettings<QspiFlash> _settings;
 };
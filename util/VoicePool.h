@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include <q/support/frequency.hpp>
+#include <q/support/phase.hpp>
+
+// One voice of a Harmony, relative to the detected pitch.
+struct HarmonyVoice
+{
+    float semitones = 0;
+    float detune_cents = 0;
+    float gain = 1;
+
+    bool operator==(const HarmonyVoice&) const = default;
+};
+
+// The set of voices played for each detected note.
+struct Harmony
+{
+    static constexpr size_t max_voices = 8;
+
+    std::array<HarmonyVoice, max_voices> voices{};
+    size_t count = 1;
+
+    bool operator==(const Harmony&) const = default;
+
+    // Adds a voice. Returns false if the harmony is full.
+    constexpr bool add(HarmonyVoice voice)
+    {
+        if (count >= max_voices) { return false; }
+        voices[count++] = voice;
+        return true;
+    }
+
+    static constexpr Harmony unison() { return {}; }
+
+    static constexpr Harmony octaves()
+    {
+        Harmony h;
+        h.add({-12, 0, 0.7f});
+        h.add({12, 0, 0.5f});
+        return h;
+    }
+
+    static constexpr Harmony fifths()
+    {
+        Harmony h;
+        h.add({7, 0, 0.7f});
+        h.add({-5, 0, 0.6f});
+        return h;
+    }
+
+    static constexpr Harmony power()
+    {
+        Harmony h;
+        h.add({7, 0, 0.8f});
+        h.add({12, 0, 0.6f});
+        h.add({-12, 0, 0.7f});
+        return h;
+    }
+
+    // Every voice of power(), doubled and detuned either side
+    static constexpr Harmony stack()
+    {
+        Harmony h;
+        h.voices[0] = {0, -6, 1};
+        h.add({0, 6, 1});
+        h.add({7, -5, 0.8f});
+        h.add({7, 5, 0.8f});
+        h.add({12, -4, 0.6f});
+        h.add({12, 4, 0.6f});
+        h.add({-12, -3, 0.7f});
+        h.add({-12, 3, 0.7f});
+        return h;
+    }
+};
+
+// Oscillator phases for the voices of a Harmony, all following one pitch.
+//
+// Voice state is kept as one array per variable, so a single loop advances
+// every voice with the same arithmetic. The voices share one oscillator
+// shape; each has its own phase, pitch ratio and gain.
+class VoicePool
+{
+public:
+    static constexpr size_t max_voices = Harmony::max_voices;
+
+    VoicePool() { setHarmony(Harmony::unison()); }
+
+    // Gains are normalized so the mix has the power of a single voice.
+    // Voices that remain keep their phase.
+    void setHarmony(const Harmony& harmony)
+    {
+        _count = std::clamp<size_t>(harmony.count, 1, max_voices);
+        _highest_ratio = 0;
+        float power = 0;
+        for (size_t v = 0; v < _count; ++v)
+        {
+            const auto& voice = harmony.voices[v];
+            const auto cents = (voice.semitones * 100) + voice.detune_cents;
+            _ratio[v] = std::exp2(cents / 1200);
+            _gain[v] = voice.gain;
+            _highest_ratio = std::max(_highest_ratio, _ratio[v]);
+            power += voice.gain * voice.gain;
+        }
+
+        const auto scale = (power > 0) ? 1 / std::sqrt(power) : 0.0f;
+        for (size_t v = 0; v < _count; ++v)
+        {
+            _gain[v] *= scale;
+        }
+        updateSteps();
+    }
+
+    size_t count() const { return _count; }
+
+    // Frequency of the detected note, before harmony ratios
+    float frequency() const { return _frequency; }
+    // Frequency of the highest voice, for picking band limits
+    float highestFrequency() const { return _frequency * _highest_ratio; }
+
+    void setFrequency(float frequency, float sample_rate)
+    {
+        _frequency = frequency;
+        _sample_rate = sample_rate;
+        updateSteps();
+    }
+
+    // Writes the sum of all voices of osc, times gain, to out.
+    template <typename Osc>
+    void render(const Osc& osc, float* out, size_t size, float gain)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            float sum = 0;
+            for (size_t v = 0; v < _count; ++v)
+            {
+                sum += osc(_phase[v]) * _gain[v];
+                _phase[v] += _step[v];
+            }
+            out[i] = sum * gain;
+        }
+    }
+
+    // Moves every voice on without rendering.
+    void advance(size_t size)
+    {
+        const auto samples = static_cast<uint32_t>(size);
+        for (size_t v = 0; v < _count; ++v)
+        {
+            _phase[v].rep += _step[v].rep * samples;
+        }
+    }
+
+private:
+    void updateSteps()
+    {
+        for (size_t v = 0; v < _count; ++v)
+        {
+            _step[v] = cycfi::q::phase(
+                cycfi::q::frequency(_frequency * _ratio[v]), _sample_rate);
+        }
+    }
+
+    size_t _count = 1;
+    float _frequency = 0;
+    float _sample_rate = 48000;
+    float _highest_ratio = 1;
+
+    std::array<cycfi::q::phase, max_voices> _phase{};
+    std::array<cycfi::q::phase, max_voices> _step{};
+    std::array<float, max_voices> _ratio{};
+    std::array<float, max_voices> _gain{};
+};
@@ -121,6 +121,15 @@ public:
         return (*this)(i) * _boost;
     }
 
+    // Inflection points of the current shape, as drawn in operator().
+    constexpr cycfi::q::phase lowEnd() const { return _low_end; }
+    constexpr cycfi::q::phase riseEnd() const { return _rise_end; }
+    constexpr cycfi::q::phase highEnd() const { return _high_end; }
+    constexpr cycfi::q::phase fallEnd() const { return _fall_end; }
+
+    // Gain applied by compensated().
+    constexpr float boost() const { return _boost; }
+
 private:
     cycfi::q::phase _low_end;
     cycfi::q::phase _rise_end;
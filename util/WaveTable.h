@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+
+#include <q/support/phase.hpp>
+
+#include <util/Fft.h>
+#include <util/WaveSynth.h>
+
+// Band-limited wavetable version of WaveSynth.
+//
+// Each shape position holds a mip-map of single-cycle tables. Level 0 keeps
+// Size/2 - 1 harmonics and every following level keeps half as many, so
+// higher pitches play from tables with nothing above Nyquist. Evaluation
+// interpolates within a table and between adjacent shape positions without
+// branches or divides.
+//
+// Size: samples per table, a power of two
+// Levels: number of mip-map levels
+// ShapesPerUnit: shape positions per unit of WaveSynth::setShape
+template <size_t Size = 512, size_t Levels = 8, size_t ShapesPerUnit = 2>
+class WaveTable
+{
+public:
+    static_assert(std::has_single_bit(Size));
+
+    static constexpr size_t shape_count = (3 * ShapesPerUnit) + 1;
+    static constexpr size_t max_harmonics = (Size / 2) - 1;
+    static constexpr size_t memory_size =
+        sizeof(float) * shape_count * Levels * (Size + 1);
+
+    // The tables themselves, kept apart from the playback state so that
+    // players can share them, and so they can sit in a different memory.
+    using Tables = std::array<float, shape_count * Levels * (Size + 1)>;
+
+    // Plays from tables, which must outlive it.
+    explicit WaveTable(const Tables& tables) : _tables(tables)
+    {
+        selectTables();
+    }
+    WaveTable(const WaveTable&) = delete;
+    WaveTable& operator=(const WaveTable&) = delete;
+
+    // Fills tables. Do this before playing from them.
+    static void generate(Tables& tables)
+    {
+        std::array<std::complex<float>, Size> spectrum;
+        std::array<std::complex<float>, max_harmonics + 1> harmonics;
+
+        for (size_t s = 0; s < shape_count; ++s)
+        {
+            const auto shape = static_cast<float>(s) / ShapesPerUnit;
+            calculateHarmonics(WaveSynth(shape), harmonics);
+
+            for (size_t level = 0; level < Levels; ++level)
+            {
+                const auto count = max_harmonics >> level;
+                spectrum.fill(0);
+                spectrum[0] = harmonics[0];
+                for (size_t k = 1; k <= count; ++k)
+                {
+                    spectrum[k] = harmonics[k];
+                    spectrum[Size - k] = std::conj(harmonics[k]);
+                }
+                fft(spectrum.data(), Size, true);
+
+                auto* table = tableAt(tables, s, level);
+                for (size_t i = 0; i < Size; ++i)
+                {
+                    table[i] = spectrum[i].real();
+                }
+                table[Size] = table[0];
+            }
+        }
+    }
+
+    // 0.0 - 3.0, as WaveSynth::setShape
+    void setShape(float shape)
+    {
+        shape = std::clamp(shape, 0.0f, 3.0f);
+        const auto position = shape * ShapesPerUnit;
+        _shape = std::min(static_cast<size_t>(position), shape_count - 2);
+        _shape_frac = position - _shape;
+        _boost = WaveSynth(shape).boost();
+        selectTables();
+    }
+
+    // Picks the mip-map level with no harmonics above Nyquist.
+    void setFrequency(float frequency, float sample_rate)
+    {
+        const auto ratio = max_harmonics * frequency / (sample_rate / 2);
+        const auto level = (ratio > 1) ? std::ceil(std::log2(ratio)) : 0.0f;
+        _level = std::min(static_cast<size_t>(level), Levels - 1);
+        selectTables();
+    }
+
+    // Level compensation for the current shape, as applied by compensated()
+    float boost() const { return _boost; }
+
+    float operator()(cycfi::q::phase p) const
+    {
+        constexpr auto shift = 32 - std::bit_width(Size - 1);
+        constexpr auto frac_mask = (uint32_t(1) << shift) - 1;
+        constexpr auto frac_scale = 1.0f / (uint32_t(1) << shift);
+
+        const auto index = p.rep >> shift;
+        const auto t = (p.rep & frac_mask) * frac_scale;
+        const auto lower =
+            _lower[index] + (t * (_lower[index + 1] - _lower[index]));
+        const auto upper =
+            _upper[index] + (t * (_upper[index + 1] - _upper[index]));
+        return lower + (_shape_frac * (upper - lower));
+    }
+
+    float operator()(cycfi::q::phase_iterator i) const
+    {
+        return (*this)(i._phase);
+    }
+
+    float compensated(cycfi::q::phase p) const
+    {
+        return (*this)(p) * _boost;
+    }
+
+    float compensated(cycfi::q::phase_iterator i) const
+    {
+        return (*this)(i) * _boost;
+    }
+
+private:
+    // Fourier series of the piecewise-linear WaveSynth shape. Integrating
+    // by parts turns each edge into a closed form, so there's no need to
+    // sample the naive wave, which would alias into the tables.
+    static void calculateHarmonics(
+        const WaveSynth& wave,
+        std::array<std::complex<float>, max_harmonics + 1>& harmonics)
+    {
+        constexpr auto two_pi = 2 * std::numbers::pi;
+        constexpr auto min_width = 1e-9;
+        const auto frac = [](cycfi::q::phase p) {
+            return p.rep / 4294967296.0;
+        };
+
+        const auto a = frac(wave.lowEnd());
+        const auto b = frac(wave.riseEnd());
+        const auto c = frac(wave.highEnd());
+        const auto d = frac(wave.fallEnd());
+
+        harmonics[0] = static_cast<float>(-a + (c - b) - (1 - d));
+        for (size_t k = 1; k <= max_harmonics; ++k)
+        {
+            const auto w = two_pi * k;
+            const std::complex<double> iw(0, w);
+            const auto e = [&](double t) {
+                double whole = 0;
+                return std::polar(1.0, -two_pi * std::modf(k * t, &whole));
+            };
+
+            const auto edge = [&](double begin, double end, double step) {
+                const auto width = end - begin;
+                return (width > min_width) ?
+                    (step / width) * (e(begin) - e(end)) / iw :
+                    step * e(begin);
+            };
+
+            const auto sum = edge(a, b, 2) + edge(c, d, -2);
+            harmonics[k] = std::complex<float>(sum / iw);
+        }
+    }
+
+    template <typename T>
+    static auto* tableAt(T& tables, size_t shape, size_t level)
+    {
+        return tables.data() + (((shape * Levels) + level) * (Size + 1));
+    }
+
+    void selectTables()
+    {
+        _lower = tableAt(_tables, _shape, _level);
+        _upper = tableAt(_tables, _shape + 1, _level);
+    }
+
+    const Tables& _tables;
+    const float* _lower = nullptr;
+    const float* _upper = nullptr;
+    size_t _shape = 0;
+    size_t _level = 0;
+    float _shape_frac = 0;
+    float _boost = 1;
+};